@@ -0,0 +1,326 @@
+#include <buried_tile_culler.h>
+#include <chunk_mesh_baker.h>
+#include <hex_tile_grid.h>
+#include <tile_batcher.h>
+#include <tile_occupier.h>
+#include <mtdebug_print.h>
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Graphics/StaticModel.h>
+#include <Urho3D/Scene/Scene.h>
+
+using namespace Urho3D;
+
+Buried_Tile_Culler::Buried_Tile_Culler(Urho3D::Context * context)
+    : Component(context), grid_revision_(0), rebuild_all_(true)
+{
+    SubscribeToEvent(E_POSTUPDATE, URHO3D_HANDLER(Buried_Tile_Culler, handle_post_update));
+}
+
+Buried_Tile_Culler::~Buried_Tile_Culler()
+{}
+
+void Buried_Tile_Culler::set_excluded(Urho3D::Node * node, bool exclude)
+{
+    if (node == nullptr)
+        return;
+
+    if (exclude)
+    {
+        excluded_[node] = node;
+        if (is_buried(node))
+            _set_buried(node, false);
+        return;
+    }
+
+    if (excluded_.Erase(node))
+        forced_.Insert(_owner_chunk(node));
+}
+
+bool Buried_Tile_Culler::is_buried(Urho3D::Node * node) const
+{
+    auto fiter = buried_.Find(node);
+    return fiter != buried_.End() && fiter->second_.node_ == node;
+}
+
+bool Buried_Tile_Culler::hides(Urho3D::Node * node)
+{
+    Scene * scn = (node != nullptr) ? node->GetScene() : nullptr;
+    Buried_Tile_Culler * culler = (scn != nullptr) ? scn->GetComponent<Buried_Tile_Culler>() : nullptr;
+    return culler != nullptr && culler->IsEnabledEffective() && culler->is_buried(node);
+}
+
+void Buried_Tile_Culler::rebuild_all()
+{
+    _show_all();
+    rebuild_all_ = true;
+}
+
+void Buried_Tile_Culler::update()
+{
+    Scene * scn = GetScene();
+    Hex_Tile_Grid * tg = (scn != nullptr) ? scn->GetComponent<Hex_Tile_Grid>() : nullptr;
+    if (tg == nullptr || !IsEnabledEffective())
+        return;
+
+    // Nodes deleted while excluded (or whose address went to a new node) are never excluded again with false
+    auto excl_iter = excluded_.Begin();
+    while (excl_iter != excluded_.End())
+    {
+        if (excl_iter->second_ != excl_iter->first_)
+            excl_iter = excluded_.Erase(excl_iter);
+        else
+            ++excl_iter;
+    }
+
+    // Moves queued in the grid this frame have to land before the revisions are read
+    tg->flush_updates();
+
+    bool full = rebuild_all_;
+    if (rebuild_all_)
+    {
+        _show_all();
+        chunk_revs_.Clear();
+        rebuild_all_ = false;
+    }
+
+    if (!full && forced_.Empty() && tg->revision() == grid_revision_)
+        return;
+    grid_revision_ = tg->revision();
+
+    HashMap<ivec3, uint32_t> prev_revs(chunk_revs_);
+    chunk_revs_.Clear();
+    tg->chunk_revisions(chunk_revs_);
+    terrain_cells_.Clear();
+
+    // Adding or removing a tile can close or open up the tiles next to it, which may be in a neighbouring chunk
+    HashSet<ivec3> dirty(forced_);
+    forced_.Clear();
+    auto rev_iter = chunk_revs_.Begin();
+    while (rev_iter != chunk_revs_.End())
+    {
+        auto fiter = prev_revs.Find(rev_iter->first_);
+        if (full || fiter == prev_revs.End() || fiter->second_ != rev_iter->second_)
+        {
+            for (int dz = -1; dz <= 1; ++dz)
+            {
+                for (int dy = -1; dy <= 1; ++dy)
+                {
+                    for (int dx = -1; dx <= 1; ++dx)
+                        dirty.Insert(Hex_Tile_Grid::chunk_key(rev_iter->first_ + ivec3(dx, dy, dz) * GRID_CHUNK_DIM));
+                }
+            }
+        }
+        ++rev_iter;
+    }
+
+    // Chunks the grid has released count as changed - whatever was buried in them has moved or gone
+    rev_iter = prev_revs.Begin();
+    while (rev_iter != prev_revs.End())
+    {
+        if (!chunk_revs_.Contains(rev_iter->first_))
+            dirty.Insert(rev_iter->first_);
+        ++rev_iter;
+    }
+
+    HashSet<Node *> classified;
+    auto dirty_iter = dirty.Begin();
+    while (dirty_iter != dirty.End())
+    {
+        HashSet<int> ids;
+        tg->chunk_node_ids(*dirty_iter, ids);
+        auto id_iter = ids.Begin();
+        while (id_iter != ids.End())
+        {
+            Node * nd = scn->GetNode(*id_iter);
+            if (nd != nullptr && !classified.Contains(nd))
+            {
+                classified.Insert(nd);
+                _classify(tg, nd);
+            }
+            ++id_iter;
+        }
+        ++dirty_iter;
+    }
+
+    // Buried tiles that are no longer in the grid where they were, and deleted ones
+    PODVector<Node *> stale;
+    auto buried_iter = buried_.Begin();
+    while (buried_iter != buried_.End())
+    {
+        if (buried_iter->second_.node_ == nullptr)
+            buried_iter = buried_.Erase(buried_iter);
+        else
+        {
+            if (dirty.Contains(buried_iter->second_.chunk_) && !classified.Contains(buried_iter->first_))
+                stale.Push(buried_iter->first_);
+            ++buried_iter;
+        }
+    }
+    for (uint32_t i = 0; i < stale.Size(); ++i)
+        _classify(tg, stale[i]);
+}
+
+uint32_t Buried_Tile_Culler::buried_count() const
+{
+    return buried_.Size();
+}
+
+void Buried_Tile_Culler::register_context(Urho3D::Context * context)
+{
+    context->RegisterFactory<Buried_Tile_Culler>();
+}
+
+void Buried_Tile_Culler::handle_post_update(Urho3D::StringHash event_type, Urho3D::VariantMap & event_data)
+{
+    update();
+}
+
+void Buried_Tile_Culler::OnSceneSet(Urho3D::Scene * scene)
+{
+    if (scene == nullptr)
+        _show_all();
+    rebuild_all_ = true;
+    Component::OnSceneSet(scene);
+}
+
+void Buried_Tile_Culler::OnSetEnabled()
+{
+    if (IsEnabledEffective())
+        rebuild_all_ = true;
+    else
+        _show_all();
+}
+
+void Buried_Tile_Culler::_classify(Hex_Tile_Grid * tg, Urho3D::Node * node)
+{
+    if (_excluded(node))
+        return;
+
+    // Compound children are out of the grid and drawn by their own nodes, so a compound root is never hidden
+    Tile_Occupier * occ = node->GetComponent<Tile_Occupier>();
+    StaticModel * sm = node->GetComponent<StaticModel>();
+    bool buried = occ != nullptr && sm != nullptr && !occ->compound() && !_hidden_elsewhere(node) &&
+                  tg->occupier_registered(occ) && _enclosed(tg, node);
+    _set_buried(node, buried);
+}
+
+void Buried_Tile_Culler::_set_buried(Urho3D::Node * node, bool buried)
+{
+    if (buried)
+    {
+        bool was_buried = is_buried(node);
+        Buried_Entry & entry = buried_[node];
+        entry.node_ = node;
+        entry.chunk_ = _owner_chunk(node);
+        if (was_buried)
+            return;
+    }
+    else if (!buried_.Erase(node))
+    {
+        return;
+    }
+
+    // The batcher and baker drop a tile that was just buried and pick it up again once it is shown
+    Scene * scn = node->GetScene();
+    Tile_Batcher * batcher = (scn != nullptr) ? scn->GetComponent<Tile_Batcher>() : nullptr;
+    if (batcher != nullptr)
+        batcher->refresh_node(node);
+    Chunk_Mesh_Baker * baker = (scn != nullptr) ? scn->GetComponent<Chunk_Mesh_Baker>() : nullptr;
+    if (baker != nullptr)
+        baker->refresh_node(node);
+
+    StaticModel * sm = node->GetComponent<StaticModel>();
+    if (sm != nullptr)
+        sm->SetEnabled(!buried);
+}
+
+bool Buried_Tile_Culler::_hidden_elsewhere(Urho3D::Node * node) const
+{
+    // Batched and baked models are disabled too but are handed back when buried - anything else was hidden on purpose
+    // and showing it again when it is uncovered would undo that
+    StaticModel * sm = node->GetComponent<StaticModel>();
+    if (sm == nullptr || sm->IsEnabled() || is_buried(node))
+        return false;
+
+    Scene * scn = node->GetScene();
+    Tile_Batcher * batcher = (scn != nullptr) ? scn->GetComponent<Tile_Batcher>() : nullptr;
+    Chunk_Mesh_Baker * baker = (scn != nullptr) ? scn->GetComponent<Chunk_Mesh_Baker>() : nullptr;
+    return (batcher == nullptr || !batcher->is_batched(node)) && (baker == nullptr || !baker->is_baked(node));
+}
+
+bool Buried_Tile_Culler::_enclosed(Hex_Tile_Grid * tg, Urho3D::Node * node)
+{
+    Tile_Occupier * occ = node->GetComponent<Tile_Occupier>();
+    ivec3 origin = Hex_Tile_Grid::world_to_grid(tg->occupier_origin(occ));
+    const Vector<ivec3> & spaces = occ->tile_spaces();
+    if (spaces.Empty())
+        return false;
+
+    HashSet<ivec3> own;
+    for (uint32_t i = 0; i < spaces.Size(); ++i)
+        own.Insert(Hex_Tile_Grid::space_cell(spaces[i], origin));
+
+    auto cell_iter = own.Begin();
+    while (cell_iter != own.End())
+    {
+        for (int d = 0; d <= GRID_NEIGHBOUR_UP; ++d)
+        {
+            ivec3 nbr = Hex_Tile_Grid::neighbour(*cell_iter, d);
+            if (!own.Contains(nbr) && !_is_terrain(tg, nbr))
+                return false;
+        }
+        ++cell_iter;
+    }
+    return true;
+}
+
+bool Buried_Tile_Culler::_is_terrain(Hex_Tile_Grid * tg, const ivec3 & cell)
+{
+    auto fiter = terrain_cells_.Find(cell);
+    if (fiter != terrain_cells_.End())
+        return fiter->second_;
+
+    bool terrain = false;
+    Scene * scn = GetScene();
+    Hex_Tile_Grid::Tile_Space items = tg->get(cell);
+    for (uint32_t i = 0; i < items.Size() && !terrain; ++i)
+        terrain = Chunk_Mesh_Baker::is_terrain_node(scn->GetNode(items[i].node_id_));
+    terrain_cells_[cell] = terrain;
+    return terrain;
+}
+
+void Buried_Tile_Culler::_show_all()
+{
+    PODVector<Node *> shown;
+    auto iter = buried_.Begin();
+    while (iter != buried_.End())
+    {
+        if (iter->second_.node_ != nullptr)
+            shown.Push(iter->first_);
+        ++iter;
+    }
+
+    for (uint32_t i = 0; i < shown.Size(); ++i)
+        _set_buried(shown[i], false);
+    buried_.Clear();
+    terrain_cells_.Clear();
+    forced_.Clear();
+    grid_revision_ = 0;
+}
+
+bool Buried_Tile_Culler::_excluded(Urho3D::Node * node) const
+{
+    auto fiter = excluded_.Find(node);
+    return fiter != excluded_.End() && fiter->second_ == node;
+}
+
+ivec3 Buried_Tile_Culler::_owner_chunk(Urho3D::Node * node)
+{
+    ivec3 cell = Hex_Tile_Grid::world_to_grid(node->GetWorldPosition());
+    Tile_Occupier * occ = node->GetComponent<Tile_Occupier>();
+    if (occ != nullptr && !occ->tile_spaces().Empty())
+        cell = Hex_Tile_Grid::space_cell(occ->tile_spaces()[0], cell);
+    return Hex_Tile_Grid::chunk_key(cell);
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <Urho3D/Scene/Component.h>
+#include <Urho3D/Container/HashSet.h>
+#include <math_utils.h>
+
+namespace Urho3D
+{
+class Scene;
+class Node;
+} // namespace Urho3D
+
+class Hex_Tile_Grid;
+
+/*!
+Hides tiles that can never be seen because every cell they occupy is closed off by terrain tiles (see
+Chunk_Mesh_Baker::is_terrain_node) on all six planar sides and above. Sides and tops shared with the tile's own cells
+count as closed. The view from below is not considered. A buried tile has its StaticModel disabled, which takes it out
+of the octree, and the batcher and baker leave it out of their groups and chunk meshes. Tiles whose StaticModel was
+disabled by something else are never buried, so uncovering them does not show them.
+
+Classification is driven by grid occupancy: each update the tiles in the chunks whose revision changed and in the
+chunks around them are re-classified, so tiles are hidden and shown again as their neighbours are added, moved or
+removed. Excluded nodes (the selection) are never hidden.
+
+Disabling the component shows every buried tile again. A buried tile's disabled model would be saved too - see
+Tile_Save_Scope.
+*/
+class Buried_Tile_Culler : public Urho3D::Component
+{
+    URHO3D_OBJECT(Buried_Tile_Culler, Urho3D::Component);
+
+  public:
+    Buried_Tile_Culler(Urho3D::Context * context);
+    ~Buried_Tile_Culler();
+
+    // Never hide node until it is excluded again with false
+    void set_excluded(Urho3D::Node * node, bool exclude);
+
+    bool is_buried(Urho3D::Node * node) const;
+
+    // Whether node is hidden by the enabled culler of its scene
+    static bool hides(Urho3D::Node * node);
+
+    // Show every tile and re-classify every chunk on the next update
+    void rebuild_all();
+
+    // Re-classify the tiles in and around the chunks that changed since the last update
+    void update();
+
+    uint32_t buried_count() const;
+
+    static void register_context(Urho3D::Context * context);
+
+    void handle_post_update(Urho3D::StringHash event_type, Urho3D::VariantMap & event_data);
+
+  protected:
+    void OnSceneSet(Urho3D::Scene * scene) override;
+
+    void OnSetEnabled() override;
+
+  private:
+    struct Buried_Entry
+    {
+        Urho3D::WeakPtr<Urho3D::Node> node_;
+
+        // Chunk holding the tile's first cell when it was buried
+        ivec3 chunk_;
+    };
+
+    void _classify(Hex_Tile_Grid * tg, Urho3D::Node * node);
+
+    void _set_buried(Urho3D::Node * node, bool buried);
+
+    // Whether node's StaticModel was disabled by something other than this culler, the batcher or the baker
+    bool _hidden_elsewhere(Urho3D::Node * node) const;
+
+    bool _enclosed(Hex_Tile_Grid * tg, Urho3D::Node * node);
+
+    bool _is_terrain(Hex_Tile_Grid * tg, const ivec3 & cell);
+
+    void _show_all();
+
+    bool _excluded(Urho3D::Node * node) const;
+
+    static ivec3 _owner_chunk(Urho3D::Node * node);
+
+    Urho3D::HashMap<Urho3D::Node *, Buried_Entry> buried_;
+
+    Urho3D::HashMap<Urho3D::Node *, Urho3D::WeakPtr<Urho3D::Node>> excluded_;
+
+    // Terrain lookups made during the current update - cleared at the start of every update
+    Urho3D::HashMap<ivec3, bool> terrain_cells_;
+
+    // Chunks to re-classify on the next update even if their revision has not changed
+    Urho3D::HashSet<ivec3> forced_;
+
+    // Grid chunk revisions as of the last update
+    Urho3D::HashMap<ivec3, uint32_t> chunk_revs_;
+
+    uint32_t grid_revision_;
+
+    bool rebuild_all_;
+};
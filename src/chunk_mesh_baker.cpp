@@ -0,0 +1,616 @@
+#include <chunk_mesh_baker.h>
+#include <hex_tile_grid.h>
+#include <tile_occupier.h>
+#include <tile_batcher.h>
+#include <buried_tile_culler.h>
+#include <mtdebug_print.h>
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Graphics/CustomGeometry.h>
+#include <Urho3D/Graphics/Geometry.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Graphics/StaticModel.h>
+#include <Urho3D/Graphics/VertexBuffer.h>
+#include <Urho3D/Scene/Scene.h>
+
+using namespace Urho3D;
+
+Chunk_Mesh_Baker::Chunk_Mesh_Baker(Urho3D::Context * context)
+    : Component(context), grid_revision_(0), rebuild_all_(true)
+{
+    SubscribeToEvent(E_POSTUPDATE, URHO3D_HANDLER(Chunk_Mesh_Baker, handle_post_update));
+}
+
+Chunk_Mesh_Baker::~Chunk_Mesh_Baker()
+{}
+
+void Chunk_Mesh_Baker::set_excluded(Urho3D::Node * node, bool exclude)
+{
+    if (node == nullptr)
+        return;
+
+    if (exclude)
+    {
+        excluded_[node] = node;
+        _unbake(node);
+        return;
+    }
+
+    if (excluded_.Erase(node))
+        refresh_node(node);
+}
+
+bool Chunk_Mesh_Baker::is_baked(Urho3D::Node * node) const
+{
+    return baked_.Contains(node);
+}
+
+void Chunk_Mesh_Baker::refresh_node(Urho3D::Node * node)
+{
+    if (node == nullptr)
+        return;
+
+    _unbake(node);
+    if (is_terrain_node(node))
+    {
+        const Vector<ivec3> & spaces = node->GetComponent<Tile_Occupier>()->tile_spaces();
+        ivec3 cell = Hex_Tile_Grid::space_cell(spaces[0], Hex_Tile_Grid::world_to_grid(node->GetWorldPosition()));
+        forced_.Insert(Hex_Tile_Grid::chunk_key(cell));
+    }
+}
+
+bool Chunk_Mesh_Baker::is_terrain_node(Urho3D::Node * node)
+{
+    if (node == nullptr || !node->HasTag(STATIC_TERRAIN_TAG))
+        return false;
+
+    Tile_Occupier * occ = node->GetComponent<Tile_Occupier>();
+    StaticModel * sm = node->GetComponent<StaticModel>();
+    return occ != nullptr && occ->tile_spaces().Size() == 1 && sm != nullptr && sm->GetModel() != nullptr;
+}
+
+Urho3D::Node * Chunk_Mesh_Baker::baked_node_at(const fvec3 & pos, const fvec3 & normal) const
+{
+    Scene * scn = GetScene();
+    Hex_Tile_Grid * tg = (scn != nullptr) ? scn->GetComponent<Hex_Tile_Grid>() : nullptr;
+    if (tg == nullptr)
+        return nullptr;
+
+    Hex_Tile_Grid::Tile_Space items = tg->get(Hex_Tile_Grid::world_to_grid(pos - normal * BAKE_PICK_INSET));
+    for (uint32_t i = 0; i < items.Size(); ++i)
+    {
+        Node * nd = scn->GetNode(items[i].node_id_);
+        if (nd != nullptr && baked_.Contains(nd))
+            return nd;
+    }
+    return nullptr;
+}
+
+void Chunk_Mesh_Baker::baked_nodes(Urho3D::Node * mesh_node, Urho3D::PODVector<Urho3D::Node *> & out) const
+{
+    auto chunk_iter = chunks_.Begin();
+    while (chunk_iter != chunks_.End())
+    {
+        if (chunk_iter->second_.node_ != mesh_node)
+        {
+            ++chunk_iter;
+            continue;
+        }
+
+        auto mem_iter = chunk_iter->second_.members_.Begin();
+        while (mem_iter != chunk_iter->second_.members_.End())
+        {
+            if (mem_iter->second_ != nullptr)
+                out.Push(mem_iter->second_);
+            ++mem_iter;
+        }
+        return;
+    }
+}
+
+void Chunk_Mesh_Baker::rebuild_all()
+{
+    rebuild_all_ = true;
+}
+
+void Chunk_Mesh_Baker::update()
+{
+    Scene * scn = GetScene();
+    Hex_Tile_Grid * tg = (scn != nullptr) ? scn->GetComponent<Hex_Tile_Grid>() : nullptr;
+    if (tg == nullptr || !IsEnabledEffective())
+        return;
+
+    // Nodes deleted while excluded (or whose address went to a new node) are never excluded again with false
+    auto excl_iter = excluded_.Begin();
+    while (excl_iter != excluded_.End())
+    {
+        if (excl_iter->second_ != excl_iter->first_)
+            excl_iter = excluded_.Erase(excl_iter);
+        else
+            ++excl_iter;
+    }
+
+    // Moves queued in the grid this frame have to land before the revisions are read
+    tg->flush_updates();
+
+    bool full = rebuild_all_;
+    if (rebuild_all_)
+    {
+        _release_all();
+        rebuild_all_ = false;
+    }
+
+    if (!full && forced_.Empty() && tg->revision() == grid_revision_)
+        return;
+    grid_revision_ = tg->revision();
+
+    HashMap<ivec3, uint32_t> prev_revs(chunk_revs_);
+    chunk_revs_.Clear();
+    tg->chunk_revisions(chunk_revs_);
+    terrain_cells_.Clear();
+
+    // A change in one chunk can cover or uncover the border faces of any chunk touching it
+    HashSet<ivec3> dirty(forced_);
+    forced_.Clear();
+    auto rev_iter = chunk_revs_.Begin();
+    while (rev_iter != chunk_revs_.End())
+    {
+        auto fiter = prev_revs.Find(rev_iter->first_);
+        if (full || fiter == prev_revs.End() || fiter->second_ != rev_iter->second_)
+        {
+            for (int dz = -1; dz <= 1; ++dz)
+            {
+                for (int dy = -1; dy <= 1; ++dy)
+                {
+                    for (int dx = -1; dx <= 1; ++dx)
+                        dirty.Insert(Hex_Tile_Grid::chunk_key(rev_iter->first_ + ivec3(dx, dy, dz) * GRID_CHUNK_DIM));
+                }
+            }
+        }
+        ++rev_iter;
+    }
+
+    // Chunks the grid has released since the last update
+    auto chunk_iter = chunks_.Begin();
+    while (chunk_iter != chunks_.End())
+    {
+        if (chunk_revs_.Contains(chunk_iter->first_))
+        {
+            ++chunk_iter;
+            continue;
+        }
+
+        _release_chunk(chunk_iter->first_, chunk_iter->second_);
+        if (chunk_iter->second_.node_ != nullptr)
+            chunk_iter->second_.node_->Remove();
+        chunk_iter = chunks_.Erase(chunk_iter);
+    }
+
+    auto dirty_iter = dirty.Begin();
+    while (dirty_iter != dirty.End())
+    {
+        auto fiter = chunk_revs_.Find(*dirty_iter);
+        if (fiter != chunk_revs_.End())
+            _bake_chunk(tg, fiter->first_, fiter->second_);
+        ++dirty_iter;
+    }
+}
+
+uint32_t Chunk_Mesh_Baker::baked_chunk_count() const
+{
+    uint32_t count = 0;
+    auto iter = chunks_.Begin();
+    while (iter != chunks_.End())
+    {
+        if (iter->second_.node_ != nullptr)
+            ++count;
+        ++iter;
+    }
+    return count;
+}
+
+uint32_t Chunk_Mesh_Baker::baked_count() const
+{
+    return baked_.Size();
+}
+
+uint32_t Chunk_Mesh_Baker::kept_triangles() const
+{
+    uint32_t count = 0;
+    auto iter = chunks_.Begin();
+    while (iter != chunks_.End())
+    {
+        count += iter->second_.kept_;
+        ++iter;
+    }
+    return count;
+}
+
+uint32_t Chunk_Mesh_Baker::culled_triangles() const
+{
+    uint32_t count = 0;
+    auto iter = chunks_.Begin();
+    while (iter != chunks_.End())
+    {
+        count += iter->second_.culled_;
+        ++iter;
+    }
+    return count;
+}
+
+void Chunk_Mesh_Baker::register_context(Urho3D::Context * context)
+{
+    context->RegisterFactory<Chunk_Mesh_Baker>();
+}
+
+void Chunk_Mesh_Baker::handle_post_update(Urho3D::StringHash event_type, Urho3D::VariantMap & event_data)
+{
+    update();
+}
+
+void Chunk_Mesh_Baker::OnSceneSet(Urho3D::Scene * scene)
+{
+    if (scene == nullptr)
+        _release_all();
+    else
+        rebuild_all_ = true;
+    Component::OnSceneSet(scene);
+}
+
+void Chunk_Mesh_Baker::OnSetEnabled()
+{
+    if (IsEnabledEffective())
+        rebuild_all_ = true;
+    else
+        _release_all();
+
+    // The batcher leaves terrain tiles to the baker only while it is enabled
+    Scene * scn = GetScene();
+    Tile_Batcher * batcher = (scn != nullptr) ? scn->GetComponent<Tile_Batcher>() : nullptr;
+    if (batcher != nullptr)
+        batcher->rebuild_all();
+}
+
+void Chunk_Mesh_Baker::_bake_chunk(Hex_Tile_Grid * tg, const ivec3 & key, uint32_t revision)
+{
+    Scene * scn = GetScene();
+    Chunk_Bake & bake = chunks_[key];
+    bake.revision_ = revision;
+    bake.kept_ = 0;
+    bake.culled_ = 0;
+
+    // Whatever is in the chunk now plus whatever was baked here before (it may have left)
+    HashSet<Node *> candidates;
+    HashSet<int> ids;
+    tg->chunk_node_ids(key, ids);
+    auto id_iter = ids.Begin();
+    while (id_iter != ids.End())
+    {
+        Node * nd = scn->GetNode(*id_iter);
+        if (nd != nullptr)
+            candidates.Insert(nd);
+        ++id_iter;
+    }
+
+    auto mem_iter = bake.members_.Begin();
+    while (mem_iter != bake.members_.End())
+    {
+        if (mem_iter->second_ != nullptr)
+            candidates.Insert(mem_iter->second_);
+        ++mem_iter;
+    }
+
+    _release_chunk(key, bake);
+
+    Tile_Batcher * batcher = scn->GetComponent<Tile_Batcher>();
+    HashMap<Material *, PODVector<Baked_Vertex>> buckets;
+    PODVector<Baked_Vertex> world_verts;
+    bool cast_shadows = false;
+    auto cand_iter = candidates.Begin();
+    while (cand_iter != candidates.End())
+    {
+        Node * nd = *cand_iter;
+        ++cand_iter;
+
+        if (baked_.Contains(nd) || _excluded(nd) || !is_terrain_node(nd) || Buried_Tile_Culler::hides(nd))
+            continue;
+
+        const Vector<ivec3> & spaces = nd->GetComponent<Tile_Occupier>()->tile_spaces();
+        ivec3 cell = Hex_Tile_Grid::space_cell(spaces[0], Hex_Tile_Grid::world_to_grid(nd->GetWorldPosition()));
+        if (Hex_Tile_Grid::chunk_key(cell) != key)
+            continue;
+
+        // A model disabled by anything but the batcher was hidden on purpose and stays out of the mesh - a batched
+        // tile is taken back from the batcher, which leaves terrain to the baker
+        StaticModel * sm = nd->GetComponent<StaticModel>();
+        if (!sm->IsEnabled())
+        {
+            if (batcher == nullptr || !batcher->is_batched(nd))
+                continue;
+            batcher->refresh_node(nd);
+        }
+        const Model_Data * md = _model_data(sm->GetModel());
+
+        bool all_mats = (md->geometries_.Size() <= sm->GetNumGeometries());
+        for (uint32_t g = 0; g < md->geometries_.Size() && all_mats; ++g)
+            all_mats = md->geometries_[g].Empty() || sm->GetMaterial(g) != nullptr;
+        if (!all_mats)
+            continue;
+
+        bool covered[GRID_NEIGHBOUR_COUNT];
+        bool any_covered = false;
+        for (int d = 0; d < GRID_NEIGHBOUR_COUNT; ++d)
+        {
+            covered[d] = _is_terrain(tg, Hex_Tile_Grid::neighbour(cell, d));
+            any_covered = any_covered || covered[d];
+        }
+
+        // Faces are tested against the tile's own outer extent in each direction, measured from its origin
+        fmat3x4 world = nd->GetWorldTransform();
+        fquat rot = nd->GetWorldRotation();
+        fvec3 center = nd->GetWorldPosition();
+        float extent[GRID_NEIGHBOUR_COUNT];
+        for (int d = 0; d < GRID_NEIGHBOUR_COUNT; ++d)
+            extent[d] = -M_INFINITY;
+
+        world_verts.Clear();
+        for (uint32_t g = 0; g < md->geometries_.Size(); ++g)
+        {
+            const PODVector<Baked_Vertex> & src = md->geometries_[g];
+            for (uint32_t i = 0; i < src.Size(); ++i)
+            {
+                Baked_Vertex v;
+                v.position_ = world * src[i].position_;
+                v.normal_ = (rot * src[i].normal_).Normalized();
+                v.uv_ = src[i].uv_;
+                fvec3 tan = rot * fvec3(src[i].tangent_.x_, src[i].tangent_.y_, src[i].tangent_.z_);
+                v.tangent_ = fvec4(tan, src[i].tangent_.w_);
+                world_verts.Push(v);
+
+                for (int d = 0; d < GRID_NEIGHBOUR_COUNT && any_covered; ++d)
+                    extent[d] = Max(extent[d], (v.position_ - center).DotProduct(_direction(d)));
+            }
+        }
+
+        uint32_t offset = 0;
+        for (uint32_t g = 0; g < md->geometries_.Size(); ++g)
+        {
+            if (md->geometries_[g].Empty())
+                continue;
+
+            PODVector<Baked_Vertex> & dest = buckets[sm->GetMaterial(g)];
+            uint32_t end = offset + md->geometries_[g].Size();
+            for (; offset < end; offset += 3)
+            {
+                const Baked_Vertex * tri = &world_verts[offset];
+                bool cull = false;
+                if (any_covered)
+                {
+                    fvec3 n = (tri[1].position_ - tri[0].position_).CrossProduct(tri[2].position_ - tri[0].position_);
+                    n.Normalize();
+                    for (int d = 0; d < GRID_NEIGHBOUR_COUNT && !cull; ++d)
+                    {
+                        fvec3 dir = _direction(d);
+                        if (!covered[d] || Abs(n.DotProduct(dir)) < BAKE_FACING_COS)
+                            continue;
+
+                        cull = true;
+                        for (int k = 0; k < 3 && cull; ++k)
+                            cull = (tri[k].position_ - center).DotProduct(dir) >= extent[d] - BAKE_BOUNDARY_TOLERANCE;
+                    }
+                }
+
+                if (cull)
+                {
+                    ++bake.culled_;
+                    continue;
+                }
+                dest.Push(tri[0]);
+                dest.Push(tri[1]);
+                dest.Push(tri[2]);
+                ++bake.kept_;
+            }
+        }
+
+        cast_shadows = cast_shadows || sm->GetCastShadows();
+        sm->SetEnabled(false);
+        bake.members_[nd] = nd;
+        baked_[nd] = key;
+    }
+
+    if (buckets.Empty())
+    {
+        if (bake.node_ != nullptr)
+            bake.node_->Remove();
+        bake.node_ = nullptr;
+        return;
+    }
+
+    if (bake.node_ == nullptr)
+    {
+        // Vertices are in world space so the mesh node just sits at the origin
+        bake.node_ = GetNode()->CreateChild(BAKED_CHUNK_NODE_NAME, LOCAL);
+        bake.node_->SetTemporary(true);
+        bake.node_->CreateComponent<CustomGeometry>(LOCAL);
+    }
+
+    CustomGeometry * cg = bake.node_->GetComponent<CustomGeometry>();
+    cg->SetNumGeometries(buckets.Size());
+    cg->SetCastShadows(cast_shadows);
+    uint32_t geom_ind = 0;
+    auto bucket_iter = buckets.Begin();
+    while (bucket_iter != buckets.End())
+    {
+        const PODVector<Baked_Vertex> & verts = bucket_iter->second_;
+        cg->BeginGeometry(geom_ind, TRIANGLE_LIST);
+        for (uint32_t i = 0; i < verts.Size(); ++i)
+        {
+            cg->DefineVertex(verts[i].position_);
+            cg->DefineNormal(verts[i].normal_);
+            cg->DefineTexCoord(verts[i].uv_);
+            cg->DefineTangent(verts[i].tangent_);
+        }
+        cg->SetMaterial(geom_ind, bucket_iter->first_);
+        ++geom_ind;
+        ++bucket_iter;
+    }
+    cg->Commit();
+}
+
+void Chunk_Mesh_Baker::_release_chunk(const ivec3 & key, Chunk_Bake & bake)
+{
+    auto mem_iter = bake.members_.Begin();
+    while (mem_iter != bake.members_.End())
+    {
+        // Nodes that moved out may already be baked in their new chunk, and a deleted node's address may have been
+        // reused by a node baked elsewhere - both are left alone
+        Node * nd = mem_iter->second_;
+        auto fiter = baked_.Find(mem_iter->first_);
+        ++mem_iter;
+        if (fiter == baked_.End() || fiter->second_ != key)
+            continue;
+
+        baked_.Erase(fiter);
+        StaticModel * sm = (nd != nullptr) ? nd->GetComponent<StaticModel>() : nullptr;
+        if (sm != nullptr)
+            sm->SetEnabled(true);
+    }
+    bake.members_.Clear();
+}
+
+void Chunk_Mesh_Baker::_release_all()
+{
+    auto chunk_iter = chunks_.Begin();
+    while (chunk_iter != chunks_.End())
+    {
+        _release_chunk(chunk_iter->first_, chunk_iter->second_);
+        if (chunk_iter->second_.node_ != nullptr)
+            chunk_iter->second_.node_->Remove();
+        ++chunk_iter;
+    }
+    chunks_.Clear();
+    baked_.Clear();
+    forced_.Clear();
+    chunk_revs_.Clear();
+    terrain_cells_.Clear();
+    grid_revision_ = 0;
+}
+
+void Chunk_Mesh_Baker::_unbake(Urho3D::Node * node)
+{
+    auto fiter = baked_.Find(node);
+    if (fiter == baked_.End())
+        return;
+
+    // Shown right away - the chunk mesh still holds the node's faces until the re-bake on the next update
+    forced_.Insert(fiter->second_);
+    auto chunk_iter = chunks_.Find(fiter->second_);
+    if (chunk_iter != chunks_.End())
+        chunk_iter->second_.members_.Erase(node);
+    baked_.Erase(fiter);
+
+    StaticModel * sm = node->GetComponent<StaticModel>();
+    if (sm != nullptr)
+        sm->SetEnabled(true);
+}
+
+bool Chunk_Mesh_Baker::_is_terrain(Hex_Tile_Grid * tg, const ivec3 & cell)
+{
+    auto fiter = terrain_cells_.Find(cell);
+    if (fiter != terrain_cells_.End())
+        return fiter->second_;
+
+    bool terrain = false;
+    Scene * scn = GetScene();
+    Hex_Tile_Grid::Tile_Space items = tg->get(cell);
+    for (uint32_t i = 0; i < items.Size() && !terrain; ++i)
+        terrain = is_terrain_node(scn->GetNode(items[i].node_id_));
+    terrain_cells_[cell] = terrain;
+    return terrain;
+}
+
+const Chunk_Mesh_Baker::Model_Data * Chunk_Mesh_Baker::_model_data(Urho3D::Model * model)
+{
+    auto fiter = model_cache_.Find(model->GetNameHash());
+    if (fiter != model_cache_.End())
+        return &fiter->second_;
+
+    // Same lod 0 extraction as the voxelizer, plus the attributes the chunk mesh carries
+    Model_Data & md = model_cache_[model->GetNameHash()];
+    md.geometries_.Resize(model->GetNumGeometries());
+    for (uint32_t g = 0; g < model->GetNumGeometries(); ++g)
+    {
+        Geometry * geom = model->GetGeometry(g, 0);
+        if (geom == nullptr || geom->GetPrimitiveType() != TRIANGLE_LIST)
+            continue;
+
+        const unsigned char * vert_data = nullptr;
+        const unsigned char * ind_data = nullptr;
+        const PODVector<VertexElement> * elements = nullptr;
+        unsigned vert_size = 0;
+        unsigned ind_size = 0;
+        geom->GetRawData(vert_data, vert_size, ind_data, ind_size, elements);
+        if (vert_data == nullptr || elements == nullptr)
+        {
+            wout << "Model" << model->GetName() << "geometry" << g << "has no shadow data to bake";
+            continue;
+        }
+
+        unsigned pos_offset = VertexBuffer::GetElementOffset(*elements, TYPE_VECTOR3, SEM_POSITION);
+        if (pos_offset == M_MAX_UNSIGNED)
+            continue;
+        unsigned norm_offset = VertexBuffer::GetElementOffset(*elements, TYPE_VECTOR3, SEM_NORMAL);
+        unsigned uv_offset = VertexBuffer::GetElementOffset(*elements, TYPE_VECTOR2, SEM_TEXCOORD);
+        unsigned tan_offset = VertexBuffer::GetElementOffset(*elements, TYPE_VECTOR4, SEM_TANGENT);
+
+        PODVector<uint32_t> verts;
+        if (ind_data != nullptr)
+        {
+            uint32_t end = geom->GetIndexStart() + geom->GetIndexCount();
+            for (uint32_t i = geom->GetIndexStart(); i < end; ++i)
+                verts.Push((ind_size == sizeof(unsigned short)) ? ((const unsigned short *)ind_data)[i]
+                                                                : ((const uint32_t *)ind_data)[i]);
+        }
+        else
+        {
+            uint32_t end = geom->GetVertexStart() + geom->GetVertexCount();
+            for (uint32_t i = geom->GetVertexStart(); i < end; ++i)
+                verts.Push(i);
+        }
+
+        PODVector<Baked_Vertex> & dest = md.geometries_[g];
+        dest.Resize(verts.Size() - verts.Size() % 3);
+        for (uint32_t i = 0; i < dest.Size(); ++i)
+        {
+            const unsigned char * vert = vert_data + verts[i] * vert_size;
+            Baked_Vertex & v = dest[i];
+            v.position_ = *(const fvec3 *)(vert + pos_offset);
+            v.normal_ = (norm_offset != M_MAX_UNSIGNED) ? *(const fvec3 *)(vert + norm_offset) : fvec3::UP;
+            v.uv_ = (uv_offset != M_MAX_UNSIGNED) ? *(const fvec2 *)(vert + uv_offset) : fvec2::ZERO;
+            v.tangent_ = (tan_offset != M_MAX_UNSIGNED) ? *(const fvec4 *)(vert + tan_offset) : fvec4(1, 0, 0, 1);
+        }
+    }
+    return &md;
+}
+
+bool Chunk_Mesh_Baker::_excluded(Urho3D::Node * node) const
+{
+    auto fiter = excluded_.Find(node);
+    return fiter != excluded_.End() && fiter->second_ == node;
+}
+
+fvec3 Chunk_Mesh_Baker::_direction(int dir)
+{
+    // Same order as Hex_Tile_Grid::neighbour - Cos and Sin of the multiples of 60 degrees, then up and down
+    static const fvec3 dirs[GRID_NEIGHBOUR_COUNT] = {fvec3(1.0f, 0.0f, 0.0f),
+                                                     fvec3(0.5f, 0.866025f, 0.0f),
+                                                     fvec3(-0.5f, 0.866025f, 0.0f),
+                                                     fvec3(-1.0f, 0.0f, 0.0f),
+                                                     fvec3(-0.5f, -0.866025f, 0.0f),
+                                                     fvec3(0.5f, -0.866025f, 0.0f),
+                                                     fvec3(0.0f, 0.0f, 1.0f),
+                                                     fvec3(0.0f, 0.0f, -1.0f)};
+    return dirs[dir];
+}
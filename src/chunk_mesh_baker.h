@@ -0,0 +1,165 @@
+#pragma once
+
+// How far inside a tile's outer extent a face can sit and still count as lying on the cell boundary
+const float BAKE_BOUNDARY_TOLERANCE = 0.02f;
+// Cosine of the largest angle between a face normal and a neighbour direction for the face to count as facing it
+const float BAKE_FACING_COS = 0.985f;
+// Distance a ray hit on a chunk mesh is moved back along the face normal to land inside the tile that was hit
+const float BAKE_PICK_INSET = 0.05f;
+
+#include <Urho3D/Scene/Component.h>
+#include <Urho3D/Container/HashSet.h>
+#include <math_utils.h>
+
+const Urho3D::String STATIC_TERRAIN_TAG = "StaticTerrain";
+const Urho3D::String BAKED_CHUNK_NODE_NAME = "Baked_Chunk";
+
+namespace Urho3D
+{
+class Scene;
+class Node;
+class Model;
+class Material;
+} // namespace Urho3D
+
+class Hex_Tile_Grid;
+
+/*!
+Merges the terrain tiles of each grid chunk in to one CustomGeometry (one vertex buffer, one geometry per material)
+and drops every face fully covered by a neighbouring terrain tile. A face is covered when it points at one of the six
+planar neighbours or the cell above or below, lies on the tile's outer extent in that direction and that cell holds
+another terrain tile - so the buried sides, tops and bottoms of stacked layers are never submitted.
+
+Terrain tiles are nodes tagged STATIC_TERRAIN_TAG with a single cell Tile_Occupier and a StaticModel. They are
+assumed to fill their cell - a tagged tile shaped otherwise would hide faces of its neighbours that are really visible.
+Baked tiles have their own StaticModel disabled, and tiles hidden by the Buried_Tile_Culler or with a StaticModel
+disabled by anything but the batcher are left out of the mesh (they still cover their neighbours). Model vertex data is read from the CPU side shadow copy.
+
+The grid chunk revisions drive the bakes: a chunk is re-baked when it changed, along with the chunks around it since
+their border faces may have been covered or uncovered. Excluded nodes (the selection) draw with their own StaticModel
+but still cover their neighbours.
+
+Disabling the component puts every tile back on its own StaticModel. Saves need a Tile_Save_Scope around them for the
+same reason as the batcher's.
+*/
+class Chunk_Mesh_Baker : public Urho3D::Component
+{
+    URHO3D_OBJECT(Chunk_Mesh_Baker, Urho3D::Component);
+
+  public:
+    Chunk_Mesh_Baker(Urho3D::Context * context);
+    ~Chunk_Mesh_Baker();
+
+    // Render node with its own StaticModel instead of the chunk mesh until it is excluded again with false
+    void set_excluded(Urho3D::Node * node, bool exclude);
+
+    bool is_baked(Urho3D::Node * node) const;
+
+    // Show node on its own now and reconsider it on the next bake of its chunk - for when something else starts or
+    // stops hiding it
+    void refresh_node(Urho3D::Node * node);
+
+    // Whether node is one the baker takes over when enabled - ie tagged terrain with a single cell and a model
+    static bool is_terrain_node(Urho3D::Node * node);
+
+    // The baked tile whose face was hit at pos (with the face normal) on one of the chunk meshes
+    Urho3D::Node * baked_node_at(const fvec3 & pos, const fvec3 & normal) const;
+
+    // The tiles baked in to the chunk mesh on mesh_node
+    void baked_nodes(Urho3D::Node * mesh_node, Urho3D::PODVector<Urho3D::Node *> & out) const;
+
+    // Drop every chunk mesh and bake every chunk on the next update
+    void rebuild_all();
+
+    // Re-bake the chunks that changed since the last update and their neighbours
+    void update();
+
+    uint32_t baked_chunk_count() const;
+
+    uint32_t baked_count() const;
+
+    // Triangles kept and culled over the current bake of every chunk
+    uint32_t kept_triangles() const;
+
+    uint32_t culled_triangles() const;
+
+    static void register_context(Urho3D::Context * context);
+
+    void handle_post_update(Urho3D::StringHash event_type, Urho3D::VariantMap & event_data);
+
+  protected:
+    void OnSceneSet(Urho3D::Scene * scene) override;
+
+    void OnSetEnabled() override;
+
+  private:
+    struct Baked_Vertex
+    {
+        fvec3 position_;
+        fvec3 normal_;
+        fvec2 uv_;
+        fvec4 tangent_;
+    };
+
+    // Model space lod 0 triangle list (three vertices per triangle) of each geometry
+    struct Model_Data
+    {
+        Urho3D::Vector<Urho3D::PODVector<Baked_Vertex>> geometries_;
+    };
+
+    struct Chunk_Bake
+    {
+        Chunk_Bake() : revision_(0), kept_(0), culled_(0)
+        {}
+
+        uint32_t revision_;
+
+        Urho3D::SharedPtr<Urho3D::Node> node_;
+
+        Urho3D::HashMap<Urho3D::Node *, Urho3D::WeakPtr<Urho3D::Node>> members_;
+
+        uint32_t kept_;
+
+        uint32_t culled_;
+    };
+
+    void _bake_chunk(Hex_Tile_Grid * tg, const ivec3 & key, uint32_t revision);
+
+    // Show the own StaticModel of every node baked in the chunk again - the chunk mesh is left alone
+    void _release_chunk(const ivec3 & key, Chunk_Bake & bake);
+
+    void _release_all();
+
+    void _unbake(Urho3D::Node * node);
+
+    bool _is_terrain(Hex_Tile_Grid * tg, const ivec3 & cell);
+
+    const Model_Data * _model_data(Urho3D::Model * model);
+
+    bool _excluded(Urho3D::Node * node) const;
+
+    // World space normal of the cell side facing Hex_Tile_Grid::neighbour in direction dir
+    static fvec3 _direction(int dir);
+
+    Urho3D::HashMap<ivec3, Chunk_Bake> chunks_;
+
+    // Chunk each baked node is baked in
+    Urho3D::HashMap<Urho3D::Node *, ivec3> baked_;
+
+    Urho3D::HashMap<Urho3D::Node *, Urho3D::WeakPtr<Urho3D::Node>> excluded_;
+
+    Urho3D::HashMap<Urho3D::StringHash, Model_Data> model_cache_;
+
+    // Terrain lookups made during the current update - cleared at the start of every update
+    Urho3D::HashMap<ivec3, bool> terrain_cells_;
+
+    // Chunks to bake on the next update even if their revision has not changed
+    Urho3D::HashSet<ivec3> forced_;
+
+    // Grid chunk revisions as of the current update
+    Urho3D::HashMap<ivec3, uint32_t> chunk_revs_;
+
+    uint32_t grid_revision_;
+
+    bool rebuild_all_;
+};
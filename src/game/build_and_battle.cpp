@@ -29,6 +29,7 @@
 
 #include <tile_occupier.h>
 #include <hex_tile_grid.h>
+#include <tile_voxelizer.h>
 #include <input_translator.h>
 #include <mtdebug_print.h>
 #include <input_translator.h>
@@ -68,6 +69,10 @@ Build_And_Battle::~Build_And_Battle()
 
 void Build_And_Battle::handle_post_render_update(StringHash event_type, VariantMap &event_data)
 {
+    Hex_Tile_Grid * tg = (scene_ != nullptr) ? scene_->GetComponent<Hex_Tile_Grid>() : nullptr;
+    if (tg != nullptr)
+        tg->push_hud_stats(GetSubsystem<DebugHud>());
+
     if (draw_debug_)
     {
         if (scene_ != nullptr)
@@ -116,6 +121,7 @@ bool Build_And_Battle::init()
 
     context_->RegisterSubsystem(new Script(context_));
     context_->RegisterSubsystem(new LuaScript(context_));
+    context_->RegisterSubsystem(new Tile_Voxelizer(context_));
 
     input_translator_->init();
 
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstdint>
+
+const uint32_t CHUNK_POOL_SLAB_SIZE = 32;
+const uint32_t CHUNK_POOL_LOCAL_MAX = 64;
+
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Container/Vector.h>
+
+/*!
+Fixed size chunk allocator shared by every grid instance in the process. Chunks are allocated in slabs which are
+never handed back to the heap until the pool is destroyed, so creating and destroying scenes does not fragment the
+heap. Each thread keeps its own free list so acquire and release are usually a pointer pop/push - the shared list is
+only touched (under the mutex) when a thread's list runs dry or grows past CHUNK_POOL_LOCAL_MAX. The pool only
+recycles the chunk itself - anything the chunk allocates on its own (like the grid's per cell item vectors) is up to
+the chunk type.
+
+T must be default constructible and have a T * next_free_ member which the pool uses to link free chunks.
+*/
+template<class T>
+class Chunk_Pool
+{
+  public:
+    static Chunk_Pool & instance()
+    {
+        static Chunk_Pool pool;
+        return pool;
+    }
+
+    T * acquire()
+    {
+        Local_List & local = _local();
+        if (local.head_ == nullptr)
+            _refill(local);
+
+        T * chunk = local.head_;
+        local.head_ = chunk->next_free_;
+        --local.count_;
+        chunk->next_free_ = nullptr;
+        return chunk;
+    }
+
+    void release(T * chunk)
+    {
+        if (chunk == nullptr)
+            return;
+
+        Local_List & local = _local();
+        chunk->next_free_ = local.head_;
+        local.head_ = chunk;
+        ++local.count_;
+
+        if (local.count_ > CHUNK_POOL_LOCAL_MAX)
+            _spill(local, local.count_ / 2);
+    }
+
+    uint32_t allocated_count()
+    {
+        Urho3D::MutexLock lock(mutex_);
+        return slabs_.Size() * CHUNK_POOL_SLAB_SIZE;
+    }
+
+    uint32_t shared_free_count()
+    {
+        Urho3D::MutexLock lock(mutex_);
+        return shared_count_;
+    }
+
+  private:
+    struct Local_List
+    {
+        Local_List() : head_(nullptr), count_(0)
+        {}
+
+        // Hand whatever this thread is holding back to the shared list when the thread exits
+        ~Local_List()
+        {
+            if (count_ != 0)
+                Chunk_Pool::instance()._spill(*this, count_);
+        }
+
+        T * head_;
+        uint32_t count_;
+    };
+
+    Chunk_Pool() : shared_head_(nullptr), shared_count_(0)
+    {}
+
+    ~Chunk_Pool()
+    {
+        for (uint32_t i = 0; i < slabs_.Size(); ++i)
+            delete[] slabs_[i];
+    }
+
+    static Local_List & _local()
+    {
+        static thread_local Local_List local;
+        return local;
+    }
+
+    void _refill(Local_List & local)
+    {
+        Urho3D::MutexLock lock(mutex_);
+
+        // Take up to a slab worth of chunks from the shared list, or allocate a new slab if it is empty
+        if (shared_head_ != nullptr)
+        {
+            uint32_t cnt = 0;
+            while (shared_head_ != nullptr && cnt < CHUNK_POOL_SLAB_SIZE)
+            {
+                T * chunk = shared_head_;
+                shared_head_ = chunk->next_free_;
+                chunk->next_free_ = local.head_;
+                local.head_ = chunk;
+                ++cnt;
+            }
+            shared_count_ -= cnt;
+            local.count_ += cnt;
+            return;
+        }
+
+        T * slab = new T[CHUNK_POOL_SLAB_SIZE];
+        slabs_.Push(slab);
+        for (uint32_t i = 0; i < CHUNK_POOL_SLAB_SIZE; ++i)
+        {
+            slab[i].next_free_ = local.head_;
+            local.head_ = &slab[i];
+        }
+        local.count_ += CHUNK_POOL_SLAB_SIZE;
+    }
+
+    void _spill(Local_List & local, uint32_t count)
+    {
+        Urho3D::MutexLock lock(mutex_);
+        for (uint32_t i = 0; i < count && local.head_ != nullptr; ++i)
+        {
+            T * chunk = local.head_;
+            local.head_ = chunk->next_free_;
+            chunk->next_free_ = shared_head_;
+            shared_head_ = chunk;
+            --local.count_;
+            ++shared_count_;
+        }
+    }
+
+    Urho3D::Mutex mutex_;
+
+    Urho3D::PODVector<T *> slabs_;
+
+    T * shared_head_;
+
+    uint32_t shared_count_;
+};
@@ -1,18 +1,103 @@
 #include <hex_tile_grid.h>
 #include <tile_occupier.h>
+#include <tile_footprint.h>
 #include <mtdebug_print.h>
 
+#include <chrono>
+
 #include <Urho3D/Graphics/DebugRenderer.h>
 #include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Engine/DebugHud.h>
+#include <Urho3D/Engine/EngineEvents.h>
+#include <Urho3D/Math/Frustum.h>
+#include <Urho3D/Math/Ray.h>
+#include <Urho3D/Resource/JSONFile.h>
 #include <Urho3D/Scene/SceneEvents.h>
 #include <Urho3D/Scene/Scene.h>
 
 using namespace Urho3D;
 
-Hex_Tile_Grid::Hex_Tile_Grid(Urho3D::Context * context) : Component(context)
+/*!
+Records a call and its duration against one of the grid ops - nested scopes (ie the multi space overloads calling the
+single space ones) only count once for the outermost call. Nothing is touched, not even the clock, unless op profiling
+is on.
+*/
+struct Hex_Tile_Grid::Op_Scope
+{
+    Op_Scope(const Hex_Tile_Grid * grid, Grid_Op op)
+        : grid_(grid), op_(op), active_(grid->op_profiling_), outer_(false)
+    {
+        if (!active_)
+            return;
+
+        outer_ = (grid_->op_depth_ == 0);
+        ++grid_->op_depth_;
+        if (outer_)
+            start_ = std::chrono::steady_clock::now();
+    }
+
+    ~Op_Scope()
+    {
+        if (!active_)
+            return;
+
+        --grid_->op_depth_;
+        if (!outer_)
+            return;
+
+        Grid_Op_Stats & ops = grid_->stats_.ops_[op_];
+        ++ops.calls_;
+        ops.total_usec_ +=
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+    const Hex_Tile_Grid * grid_;
+    Grid_Op op_;
+    bool active_;
+    bool outer_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+void Hex_Tile_Grid::Grid_Chunk::reset()
+{
+    // Small item capacity is kept so re-used chunks do not have to allocate again on placement, but a cell that once
+    // held a big stack of items would otherwise hold on to that memory for as long as the pool lives
+    for (uint32_t i = 0; i < GRID_CHUNK_CELLS; ++i)
+    {
+        cells_[i].Clear();
+        if (cells_[i].Capacity() > GRID_CELL_KEEP_CAPACITY)
+            cells_[i].Compact();
+    }
+    occupied_ = 0;
+    ++revision_;
+}
+
+uint32_t Hex_Tile_Grid::Grid_Chunk::cell_offset(const Map_Index & index_)
+{
+    return ((index_.z_ % GRID_CHUNK_DIM) * GRID_CHUNK_DIM + index_.y_ % GRID_CHUNK_DIM) * GRID_CHUNK_DIM +
+           index_.x_ % GRID_CHUNK_DIM;
+}
+
+Hex_Tile_Grid::Map_Index Hex_Tile_Grid::Grid_Chunk::cell_index(uint32_t offset) const
+{
+    return Map_Index(index_.quad_index,
+                     index_.x_ + offset % GRID_CHUNK_DIM,
+                     index_.y_ + (offset / GRID_CHUNK_DIM) % GRID_CHUNK_DIM,
+                     index_.z_ + offset / (GRID_CHUNK_DIM * GRID_CHUNK_DIM));
+}
+
+Hex_Tile_Grid::Hex_Tile_Grid(Urho3D::Context * context)
+    : Component(context), op_depth_(0), op_profiling_(false), deferred_(false), moves_suppressed_(false),
+      batch_depth_(0),
+      debug_mode_(DEBUG_DRAW_VISIBLE_CHUNKS),
+      occ_debug_dirty_(true),
+      revision_(0)
 {
     SubscribeToEvent(E_COMPONENTADDED, URHO3D_HANDLER(Hex_Tile_Grid, handle_component_added));
     SubscribeToEvent(E_COMPONENTREMOVED, URHO3D_HANDLER(Hex_Tile_Grid, handle_component_removed));
+    SubscribeToEvent(E_CONSOLECOMMAND, URHO3D_HANDLER(Hex_Tile_Grid, handle_console_command));
+    SubscribeToEvent(E_POSTUPDATE, URHO3D_HANDLER(Hex_Tile_Grid, handle_post_update));
 
     init();
 }
@@ -24,22 +109,47 @@ Hex_Tile_Grid::~Hex_Tile_Grid()
 
 void Hex_Tile_Grid::release()
 {
+    Chunk_Pool_Type & pool = Chunk_Pool_Type::instance();
+    for (uint32_t i = 0; i < chunks_.Size(); ++i)
+    {
+        chunks_[i]->reset();
+        pool.release(chunks_[i]);
+    }
+    chunks_.Clear();
+    debug_cache_.Clear();
+    scene_occ_comps_.Clear();
+    dirty_occs_.Clear();
+    batch_moved_.Clear();
+    batch_added_.Clear();
+    occ_debug_lines_.Clear();
+    occ_debug_dirty_ = true;
     world_map_.Clear();
+    stats_.occupied_cells_ = 0;
+    stats_.item_count_ = 0;
+    ++revision_;
+    _recount_allocation();
 }
 
 void Hex_Tile_Grid::init()
 {
+    // Only the chunk tables are sized up front - the chunks themselves are pulled from the pool when first written to
+    const uint32_t default_chunks = DEFAULT_GRID_SIZE / GRID_CHUNK_DIM;
     world_map_.Resize(QUADRANT_COUNT);
     for (uint32_t i = 0; i < QUADRANT_COUNT; ++i)
     {
-        world_map_[i].Resize(DEFAULT_GRID_SIZE);
-        for (uint32_t j = 0; j < DEFAULT_GRID_SIZE; ++j)
+        world_map_[i].Resize(default_chunks);
+        for (uint32_t j = 0; j < default_chunks; ++j)
         {
-            world_map_[i][j].Resize(DEFAULT_GRID_SIZE);
-            for (uint32_t k = 0; k < DEFAULT_GRID_SIZE; ++k)
-                world_map_[i][j][k].Resize(DEFAULT_GRID_SIZE);
+            world_map_[i][j].Resize(default_chunks);
+            for (uint32_t k = 0; k < default_chunks; ++k)
+            {
+                world_map_[i][j][k].Resize(default_chunks);
+                for (uint32_t c = 0; c < default_chunks; ++c)
+                    world_map_[i][j][k][c] = nullptr;
+            }
         }
     }
+    _recount_allocation();
 }
 
 void Hex_Tile_Grid::add(const Tile_Item & item, const fvec3 & pos)
@@ -49,21 +159,43 @@ void Hex_Tile_Grid::add(const Tile_Item & item, const fvec3 & pos)
 
 void Hex_Tile_Grid::add(const Tile_Item & item, const ivec3 & space, const fvec3 & origin)
 {
-    ivec3 adjusted_space = space + world_to_grid(origin);
+    Op_Scope scope(this, GRID_OP_ADD);
+    ivec3 adjusted_space = space_cell(space, world_to_grid(origin));
     Map_Index ind = grid_to_index(adjusted_space);
 
-    // If adjusted_space is out of bounds, allocate more memory to accomadate
-    if (!_check_bounds(ind))
-        _resize_for_space(ind);
+    // If adjusted_space is out of bounds or its chunk has not been used yet, grab a chunk to accomadate
+    Grid_Chunk * chunk = _acquire_chunk(ind);
 
-    if (!world_map_[ind.quad_index][ind.z_][ind.y_][ind.x_].Contains(item))
-        world_map_[ind.quad_index][ind.z_][ind.y_][ind.x_].Push(item);
+    Tile_Space & tile_space = chunk->cells_[Grid_Chunk::cell_offset(ind)];
+    auto found = tile_space.Find(item);
+    if (found != tile_space.End())
+    {
+        if (found->active_ != item.active_)
+        {
+            found->active_ = item.active_;
+            ++chunk->revision_;
+            ++revision_;
+        }
+    }
+    else
+    {
+        if (tile_space.Empty())
+        {
+            ++stats_.occupied_cells_;
+            ++chunk->occupied_;
+        }
+        ++stats_.item_count_;
+        ++chunk->revision_;
+        ++revision_;
+        tile_space.Push(item);
+    }
 }
 
 void Hex_Tile_Grid::add(const Tile_Item & item,
                         const Urho3D::Vector<ivec3> & pSpaces,
                         const fvec3 & origin)
 {
+    Op_Scope scope(this, GRID_OP_ADD);
     for (uint32_t i = 0; i < pSpaces.Size(); ++i)
         add(item, pSpaces[i], origin);
 }
@@ -71,19 +203,19 @@ void Hex_Tile_Grid::add(const Tile_Item & item,
 Urho3D::Vector<Hex_Tile_Grid::Tile_Space>
 Hex_Tile_Grid::get_spaces_with_item(const Tile_Item & item)
 {
+    Op_Scope scope(this, GRID_OP_REGION);
     Urho3D::Vector<Hex_Tile_Grid::Tile_Space> ret;
-    for (uint32_t i = 0; i < QUADRANT_COUNT; ++i)
+    for (uint32_t i = 0; i < chunks_.Size(); ++i)
     {
-        for (uint32_t z = 0; z < world_map_[i].Size(); ++z)
+        if (chunks_[i]->occupied_ == 0)
+            continue;
+
+        for (uint32_t c = 0; c < GRID_CHUNK_CELLS; ++c)
         {
-            for (uint32_t y = 0; y < world_map_[i][z].Size(); ++y)
-            {
-                for (uint32_t x = 0; x < world_map_[i][z][y].Size(); ++x)
-                {
-                    if (!world_map_[i][z][y][x].Empty())
-                        ret.Push(world_map_[i][z][y][x]);
-                }
-            }
+            const Tile_Space & cell = chunks_[i]->cells_[c];
+            auto found = cell.Find(item);
+            if (found != cell.End() && found->active_)
+                ret.Push(_active_items(cell));
         }
     }
     return ret;
@@ -91,10 +223,11 @@ Hex_Tile_Grid::get_spaces_with_item(const Tile_Item & item)
 
 const Hex_Tile_Grid::Tile_Space & Hex_Tile_Grid::at(const Map_Index & space) const
 {
-    if (!_check_bounds(space))
+    Grid_Chunk * chunk = _chunk(space);
+    if (chunk == nullptr)
         return dummy_ret_;
 
-    return world_map_[space.quad_index][space.z_][space.y_][space.x_];
+    return chunk->cells_[Grid_Chunk::cell_offset(space)];
 }
 
 Hex_Tile_Grid::Tile_Space Hex_Tile_Grid::get(const fvec3 & pos) const
@@ -107,19 +240,40 @@ Hex_Tile_Grid::Tile_Space Hex_Tile_Grid::get(const ivec3 & space, const fvec3 &
     if (!occupied(space, origin)) // also will check bounds here and return false if out of bounds
         return Tile_Space();
 
-    ivec3 adjusted_space = space + world_to_grid(origin);
+    ivec3 adjusted_space = space_cell(space, world_to_grid(origin));
     Map_Index ind = grid_to_index(adjusted_space);
 
-    // safe to raw index access because we know the indices are in bounds of the quadrant
-    return world_map_[ind.quad_index][ind.z_][ind.y_][ind.x_];
+    return _active_items(at(ind));
+}
+
+bool Hex_Tile_Grid::_has_active(const Tile_Space & space)
+{
+    for (uint32_t i = 0; i < space.Size(); ++i)
+    {
+        if (space[i].active_)
+            return true;
+    }
+    return false;
 }
 
-int32_t Hex_Tile_Grid::min_layer()
+Hex_Tile_Grid::Tile_Space Hex_Tile_Grid::_active_items(const Tile_Space & space)
+{
+    Tile_Space ret;
+    ret.Reserve(space.Size());
+    for (uint32_t i = 0; i < space.Size(); ++i)
+    {
+        if (space[i].active_)
+            ret.Push(space[i]);
+    }
+    return ret;
+}
+
+int32_t Hex_Tile_Grid::min_layer() const
 {
     int32_t minVal = 0;
-    for (uint32_t i = 3; i < 8; ++i)
+    for (uint32_t i = BOTTOM_RIGHT_FRONT; i < QUADRANT_COUNT; ++i)
     {
-        int32_t size = static_cast<int32_t>(world_map_[i].Size());
+        int32_t size = static_cast<int32_t>(world_map_[i].Size() * GRID_CHUNK_DIM);
         size *= -1;
         if (size < minVal)
             minVal = size;
@@ -127,12 +281,12 @@ int32_t Hex_Tile_Grid::min_layer()
     return minVal;
 }
 
-int32_t Hex_Tile_Grid::max_layer()
+int32_t Hex_Tile_Grid::max_layer() const
 {
     int32_t maxVal = 0;
     for (uint32_t i = 0; i < 4; ++i)
     {
-        int32_t size = static_cast<int32_t>(world_map_[i].Size());
+        int32_t size = static_cast<int32_t>(world_map_[i].Size() * GRID_CHUNK_DIM);
         size -= 1;
         if (size > maxVal)
             maxVal = size;
@@ -146,28 +300,28 @@ int32_t Hex_Tile_Grid::min_y()
 
     for (uint32_t i = 0; i < world_map_[2].Size(); ++i)
     {
-        int32_t lowestIndex = static_cast<int32_t>(world_map_[2][i].Size()) * -1;
+        int32_t lowestIndex = static_cast<int32_t>(world_map_[2][i].Size() * GRID_CHUNK_DIM) * -1;
         if (lowestIndex < minY)
             minY = lowestIndex;
     }
 
     for (uint32_t i = 0; i < world_map_[3].Size(); ++i)
     {
-        int32_t lowestIndex = static_cast<int32_t>(world_map_[3][i].Size()) * -1;
+        int32_t lowestIndex = static_cast<int32_t>(world_map_[3][i].Size() * GRID_CHUNK_DIM) * -1;
         if (lowestIndex < minY)
             minY = lowestIndex;
     }
 
     for (uint32_t i = 0; i < world_map_[6].Size(); ++i)
     {
-        int32_t lowestIndex = static_cast<int32_t>(world_map_[6][i].Size()) * -1;
+        int32_t lowestIndex = static_cast<int32_t>(world_map_[6][i].Size() * GRID_CHUNK_DIM) * -1;
         if (lowestIndex < minY)
             minY = lowestIndex;
     }
 
     for (uint32_t i = 0; i < world_map_[7].Size(); ++i)
     {
-        int32_t lowestIndex = static_cast<int32_t>(world_map_[7][i].Size()) * -1;
+        int32_t lowestIndex = static_cast<int32_t>(world_map_[7][i].Size() * GRID_CHUNK_DIM) * -1;
         if (lowestIndex < minY)
             minY = lowestIndex;
     }
@@ -180,28 +334,28 @@ int32_t Hex_Tile_Grid::max_y()
 
     for (uint32_t i = 0; i < world_map_[0].Size(); ++i)
     {
-        int32_t highestIndex = static_cast<int32_t>(world_map_[0][i].Size()) - 1;
+        int32_t highestIndex = static_cast<int32_t>(world_map_[0][i].Size() * GRID_CHUNK_DIM) - 1;
         if (highestIndex > maxY)
             maxY = highestIndex;
     }
 
     for (uint32_t i = 0; i < world_map_[1].Size(); ++i)
     {
-        int32_t highestIndex = static_cast<int32_t>(world_map_[1][i].Size()) - 1;
+        int32_t highestIndex = static_cast<int32_t>(world_map_[1][i].Size() * GRID_CHUNK_DIM) - 1;
         if (highestIndex > maxY)
             maxY = highestIndex;
     }
 
     for (uint32_t i = 0; i < world_map_[4].Size(); ++i)
     {
-        int32_t highestIndex = static_cast<int32_t>(world_map_[4][i].Size()) - 1;
+        int32_t highestIndex = static_cast<int32_t>(world_map_[4][i].Size() * GRID_CHUNK_DIM) - 1;
         if (highestIndex > maxY)
             maxY = highestIndex;
     }
 
     for (uint32_t i = 0; i < world_map_[5].Size(); ++i)
     {
-        int32_t highestIndex = static_cast<int32_t>(world_map_[5][i].Size()) - 1;
+        int32_t highestIndex = static_cast<int32_t>(world_map_[5][i].Size() * GRID_CHUNK_DIM) - 1;
         if (highestIndex > maxY)
             maxY = highestIndex;
     }
@@ -216,7 +370,7 @@ int32_t Hex_Tile_Grid::min_x()
     {
         for (uint32_t j = 0; j < world_map_[1][i].Size(); ++j)
         {
-            int32_t lowestIndex = static_cast<int32_t>(world_map_[1][i][j].Size()) * -1;
+            int32_t lowestIndex = static_cast<int32_t>(world_map_[1][i][j].Size() * GRID_CHUNK_DIM) * -1;
             if (lowestIndex < minX)
                 minX = lowestIndex;
         }
@@ -226,7 +380,7 @@ int32_t Hex_Tile_Grid::min_x()
     {
         for (uint32_t j = 0; j < world_map_[3][i].Size(); ++j)
         {
-            int32_t lowestIndex = static_cast<int32_t>(world_map_[3][i][j].Size()) * -1;
+            int32_t lowestIndex = static_cast<int32_t>(world_map_[3][i][j].Size() * GRID_CHUNK_DIM) * -1;
             if (lowestIndex < minX)
                 minX = lowestIndex;
         }
@@ -236,7 +390,7 @@ int32_t Hex_Tile_Grid::min_x()
     {
         for (uint32_t j = 0; j < world_map_[5][i].Size(); ++j)
         {
-            int32_t lowestIndex = static_cast<int32_t>(world_map_[5][i][j].Size()) * -1;
+            int32_t lowestIndex = static_cast<int32_t>(world_map_[5][i][j].Size() * GRID_CHUNK_DIM) * -1;
             if (lowestIndex < minX)
                 minX = lowestIndex;
         }
@@ -246,7 +400,7 @@ int32_t Hex_Tile_Grid::min_x()
     {
         for (uint32_t j = 0; j < world_map_[7][i].Size(); ++j)
         {
-            int32_t lowestIndex = static_cast<int32_t>(world_map_[7][i][j].Size()) * -1;
+            int32_t lowestIndex = static_cast<int32_t>(world_map_[7][i][j].Size() * GRID_CHUNK_DIM) * -1;
             if (lowestIndex < minX)
                 minX = lowestIndex;
         }
@@ -262,7 +416,7 @@ int32_t Hex_Tile_Grid::max_x()
     {
         for (uint32_t j = 0; j < world_map_[0][i].Size(); ++j)
         {
-            int32_t highestIndex = static_cast<int32_t>(world_map_[0][i][j].Size()) - 1;
+            int32_t highestIndex = static_cast<int32_t>(world_map_[0][i][j].Size() * GRID_CHUNK_DIM) - 1;
             if (highestIndex > maxX)
                 maxX = highestIndex;
         }
@@ -272,7 +426,7 @@ int32_t Hex_Tile_Grid::max_x()
     {
         for (uint32_t j = 0; j < world_map_[2][i].Size(); ++j)
         {
-            int32_t highestIndex = static_cast<int32_t>(world_map_[2][i][j].Size()) - 1;
+            int32_t highestIndex = static_cast<int32_t>(world_map_[2][i][j].Size() * GRID_CHUNK_DIM) - 1;
             if (highestIndex > maxX)
                 maxX = highestIndex;
         }
@@ -282,7 +436,7 @@ int32_t Hex_Tile_Grid::max_x()
     {
         for (uint32_t j = 0; j < world_map_[4][i].Size(); ++j)
         {
-            int32_t highestIndex = static_cast<int32_t>(world_map_[4][i][j].Size()) - 1;
+            int32_t highestIndex = static_cast<int32_t>(world_map_[4][i][j].Size() * GRID_CHUNK_DIM) - 1;
             if (highestIndex > maxX)
                 maxX = highestIndex;
         }
@@ -292,7 +446,7 @@ int32_t Hex_Tile_Grid::max_x()
     {
         for (uint32_t j = 0; j < world_map_[6][i].Size(); ++j)
         {
-            int32_t highestIndex = static_cast<int32_t>(world_map_[6][i][j].Size()) - 1;
+            int32_t highestIndex = static_cast<int32_t>(world_map_[6][i][j].Size() * GRID_CHUNK_DIM) - 1;
             if (highestIndex > maxX)
                 maxX = highestIndex;
         }
@@ -302,34 +456,34 @@ int32_t Hex_Tile_Grid::max_x()
 
 Hex_Tile_Grid::Grid_Bounds Hex_Tile_Grid::occupied_bounds()
 {
+    Op_Scope scope(this, GRID_OP_REGION);
     Grid_Bounds g;
-    for (uint32_t i = 0; i < 8; ++i)
+    for (uint32_t i = 0; i < chunks_.Size(); ++i)
     {
-        for (uint32_t z = 0; z < world_map_[i].Size(); ++z)
+        Grid_Chunk * chunk = chunks_[i];
+        if (chunk->occupied_ == 0)
+            continue;
+
+        for (uint32_t c = 0; c < GRID_CHUNK_CELLS; ++c)
         {
-            for (uint32_t y = 0; y < world_map_[i][z].Size(); ++y)
-            {
-                for (uint32_t x = 0; x < world_map_[i][z][y].Size(); ++x)
-                {
-                    if (!world_map_[i][z][y][x].Empty())
-                    {
-                        ivec3 gridPos = index_to_grid(Map_Index(i, x, y, z));
-                        if (gridPos.x_ > g.max_space_.x_)
-                            g.max_space_.x_ = gridPos.x_;
-                        if (gridPos.y_ > g.max_space_.y_)
-                            g.max_space_.y_ = gridPos.y_;
-                        if (gridPos.z_ > g.max_space_.z_)
-                            g.max_space_.z_ = gridPos.z_;
-
-                        if (gridPos.x_ < g.min_space_.x_)
-                            g.min_space_.x_ = gridPos.x_;
-                        if (gridPos.y_ < g.min_space_.y_)
-                            g.min_space_.y_ = gridPos.y_;
-                        if (gridPos.z_ < g.min_space_.z_)
-                            g.min_space_.z_ = gridPos.z_;
-                    }
-                }
-            }
+            // Cells holding only inactive items are skipped like every other query skips them
+            if (!_has_active(chunk->cells_[c]))
+                continue;
+
+            ivec3 gridPos = index_to_grid(chunk->cell_index(c));
+            if (gridPos.x_ > g.max_space_.x_)
+                g.max_space_.x_ = gridPos.x_;
+            if (gridPos.y_ > g.max_space_.y_)
+                g.max_space_.y_ = gridPos.y_;
+            if (gridPos.z_ > g.max_space_.z_)
+                g.max_space_.z_ = gridPos.z_;
+
+            if (gridPos.x_ < g.min_space_.x_)
+                g.min_space_.x_ = gridPos.x_;
+            if (gridPos.y_ < g.min_space_.y_)
+                g.min_space_.y_ = gridPos.y_;
+            if (gridPos.z_ < g.min_space_.z_)
+                g.min_space_.z_ = gridPos.z_;
         }
     }
     return g;
@@ -345,16 +499,14 @@ bool Hex_Tile_Grid::occupied(const ivec3 & space,
                              const fvec3 & origin,
                              const Urho3D::Vector<Tile_Item> & allowed_items) const
 {
-    ivec3 adjusted_space = space + world_to_grid(origin);
+    Op_Scope scope(this, GRID_OP_OCCUPIED);
+    ivec3 adjusted_space = space_cell(space, world_to_grid(origin));
     Map_Index ind = grid_to_index(adjusted_space);
 
-    if (!_check_bounds(ind))
-        return false;
-
-    const Urho3D::Vector<Tile_Item> & item_vec = world_map_[ind.quad_index][ind.z_][ind.y_][ind.x_];
+    const Urho3D::Vector<Tile_Item> & item_vec = at(ind);
     for (int i = 0; i < item_vec.Size(); ++i)
     {
-        if (!allowed_items.Contains(item_vec[i]))
+        if (item_vec[i].active_ && !allowed_items.Contains(item_vec[i]))
             return true;
     }
     return false;
@@ -364,6 +516,7 @@ Urho3D::Vector<int> Hex_Tile_Grid::occupied(const Urho3D::Vector<ivec3> & pSpace
                                             const fvec3 & origin,
                                             const Urho3D::Vector<Tile_Item> & allowed_items) const
 {
+    Op_Scope scope(this, GRID_OP_OCCUPIED);
     Urho3D::Vector<int> ret;
     for (uint32_t i = 0; i < pSpaces.Size(); ++i)
     {
@@ -373,6 +526,216 @@ Urho3D::Vector<int> Hex_Tile_Grid::occupied(const Urho3D::Vector<ivec3> & pSpace
     return ret;
 }
 
+bool Hex_Tile_Grid::occupied_excluding(const ivec3 & grid_, const Urho3D::HashSet<int> & excluded_ids) const
+{
+    Op_Scope scope(this, GRID_OP_OCCUPIED);
+    const Tile_Space & item_vec = at(grid_to_index(grid_));
+    for (uint32_t i = 0; i < item_vec.Size(); ++i)
+    {
+        if (item_vec[i].active_ && !excluded_ids.Contains(item_vec[i].node_id_))
+            return true;
+    }
+    return false;
+}
+
+bool Hex_Tile_Grid::column_top(int32_t x, int32_t y, int32_t & top_z) const
+{
+    Op_Scope scope(this, GRID_OP_OCCUPIED);
+    int32_t bottom = min_layer();
+    int32_t z = max_layer();
+    while (z >= bottom)
+    {
+        // Bottom quadrant indices count down from z = -1, so their chunks start at the top
+        Map_Index ind = grid_to_index(ivec3(x, y, z));
+        int32_t in_chunk = int32_t(ind.z_ % GRID_CHUNK_DIM);
+        if (ind.quad_index >= BOTTOM_RIGHT_FRONT)
+            in_chunk = GRID_CHUNK_DIM - 1 - in_chunk;
+        int32_t chunk_bottom = z - in_chunk;
+
+        // Unallocated and empty chunks are stepped over whole
+        const Grid_Chunk * chunk = _chunk(ind);
+        if (chunk == nullptr || chunk->occupied_ == 0)
+        {
+            z = chunk_bottom - 1;
+            continue;
+        }
+
+        for (; z >= chunk_bottom; --z)
+        {
+            const Tile_Space & item_vec = chunk->cells_[Grid_Chunk::cell_offset(grid_to_index(ivec3(x, y, z)))];
+            for (uint32_t i = 0; i < item_vec.Size(); ++i)
+            {
+                if (item_vec[i].active_)
+                {
+                    top_z = z;
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+bool Hex_Tile_Grid::raycast(const Urho3D::Ray & ray, Grid_Ray_Hit & hit, float max_distance) const
+{
+    Op_Scope scope(this, GRID_OP_OCCUPIED);
+
+    // Clip the ray to the slab of allocated layers so only the part that can hit anything is marched
+    float z_lo = (min_layer() - 0.5f) * Z_GRID;
+    float z_hi = (max_layer() + 0.5f) * Z_GRID;
+    float t_begin = 0.0f;
+    float t_end = Min(max_distance, GRID_RAY_MAX_DISTANCE);
+    if (Abs(ray.direction_.z_) < M_EPSILON)
+    {
+        if (ray.origin_.z_ < z_lo || ray.origin_.z_ > z_hi)
+            return false;
+    }
+    else
+    {
+        float t_lo = (z_lo - ray.origin_.z_) / ray.direction_.z_;
+        float t_hi = (z_hi - ray.origin_.z_) / ray.direction_.z_;
+        if (t_lo > t_hi)
+            Swap(t_lo, t_hi);
+        t_begin = Max(t_begin, t_lo);
+        t_end = Min(t_end, t_hi);
+    }
+
+    ivec3 prev_cell(M_MAX_INT, M_MAX_INT, M_MAX_INT);
+    for (float t = t_begin; t <= t_end; t += GRID_RAY_STEP)
+    {
+        ivec3 cell = world_to_grid(ray.origin_ + ray.direction_ * t);
+        if (cell == prev_cell)
+            continue;
+        prev_cell = cell;
+
+        const Tile_Space & item_vec = at(grid_to_index(cell));
+        for (uint32_t i = 0; i < item_vec.Size(); ++i)
+        {
+            if (item_vec[i].active_)
+            {
+                hit.cell_ = cell;
+                hit.item_ = item_vec[i];
+                hit.distance_ = t;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+Urho3D::PODVector<ivec3> Hex_Tile_Grid::column_tops(const Urho3D::Frustum * within) const
+{
+    Op_Scope scope(this, GRID_OP_REGION);
+
+    // A column's top can be in a chunk above the frustum, so the whole stack over a chunk inside it is scanned
+    HashSet<ivec2> stacks;
+    if (within != nullptr)
+    {
+        for (uint32_t i = 0; i < chunks_.Size(); ++i)
+        {
+            const Grid_Chunk * chunk = chunks_[i];
+            if (chunk->occupied_ == 0 || within->IsInsideFast(chunk_world_bounds(chunk)) == OUTSIDE)
+                continue;
+
+            ivec3 key = index_to_grid(chunk->index_);
+            stacks.Insert(ivec2(key.x_, key.y_));
+        }
+    }
+
+    HashMap<ivec2, int32_t> tops;
+    for (uint32_t i = 0; i < chunks_.Size(); ++i)
+    {
+        const Grid_Chunk * chunk = chunks_[i];
+        if (chunk->occupied_ == 0)
+            continue;
+
+        if (within != nullptr)
+        {
+            ivec3 key = index_to_grid(chunk->index_);
+            if (!stacks.Contains(ivec2(key.x_, key.y_)))
+                continue;
+        }
+
+        for (uint32_t c = 0; c < GRID_CHUNK_CELLS; ++c)
+        {
+            const Tile_Space & item_vec = chunk->cells_[c];
+            bool active = false;
+            for (uint32_t j = 0; j < item_vec.Size() && !active; ++j)
+                active = item_vec[j].active_;
+            if (!active)
+                continue;
+
+            ivec3 cell = index_to_grid(chunk->cell_index(c));
+            ivec2 column(cell.x_, cell.y_);
+            auto iter = tops.Find(column);
+            if (iter == tops.End())
+                tops[column] = cell.z_;
+            else if (cell.z_ > iter->second_)
+                iter->second_ = cell.z_;
+        }
+    }
+
+    PODVector<ivec3> ret;
+    ret.Reserve(tops.Size());
+    auto iter = tops.Begin();
+    while (iter != tops.End())
+    {
+        ret.Push(ivec3(iter->first_.x_, iter->first_.y_, iter->second_));
+        ++iter;
+    }
+    return ret;
+}
+
+void Hex_Tile_Grid::chunk_revisions(Urho3D::HashMap<ivec3, uint32_t> & out) const
+{
+    for (uint32_t i = 0; i < chunks_.Size(); ++i)
+        out[index_to_grid(chunks_[i]->index_)] = chunks_[i]->revision_;
+}
+
+void Hex_Tile_Grid::chunk_node_ids(const ivec3 & key, Urho3D::HashSet<int> & out) const
+{
+    Op_Scope scope(this, GRID_OP_REGION);
+    const Grid_Chunk * chunk = _chunk(grid_to_index(key));
+    if (chunk == nullptr || chunk->occupied_ == 0)
+        return;
+
+    for (uint32_t c = 0; c < GRID_CHUNK_CELLS; ++c)
+    {
+        const Tile_Space & item_vec = chunk->cells_[c];
+        for (uint32_t j = 0; j < item_vec.Size(); ++j)
+        {
+            if (item_vec[j].active_)
+                out.Insert(item_vec[j].node_id_);
+        }
+    }
+}
+
+void Hex_Tile_Grid::chunk_occupied_cells(const ivec3 & key, Urho3D::PODVector<ivec3> & out) const
+{
+    Op_Scope scope(this, GRID_OP_REGION);
+    const Grid_Chunk * chunk = _chunk(grid_to_index(key));
+    if (chunk == nullptr || chunk->occupied_ == 0)
+        return;
+
+    for (uint32_t c = 0; c < GRID_CHUNK_CELLS; ++c)
+    {
+        const Tile_Space & item_vec = chunk->cells_[c];
+        for (uint32_t j = 0; j < item_vec.Size(); ++j)
+        {
+            if (item_vec[j].active_)
+            {
+                out.Push(index_to_grid(chunk->cell_index(c)));
+                break;
+            }
+        }
+    }
+}
+
+uint32_t Hex_Tile_Grid::revision() const
+{
+    return revision_;
+}
+
 bool Hex_Tile_Grid::remove(const fvec3 & pos, const Urho3D::Vector<Tile_Item> & items)
 {
     return remove(ivec3(), pos, items);
@@ -382,22 +745,37 @@ bool Hex_Tile_Grid::remove(const ivec3 & space,
                            const fvec3 & origin,
                            const Urho3D::Vector<Tile_Item> & items)
 {
+    Op_Scope scope(this, GRID_OP_REMOVE);
     bool ret = false;
 
-    ivec3 adjusted_space = space + world_to_grid(origin);
+    ivec3 adjusted_space = space_cell(space, world_to_grid(origin));
     Map_Index ind = grid_to_index(adjusted_space);
 
-    if (!_check_bounds(ind))
+    Grid_Chunk * chunk = _chunk(ind);
+    if (chunk == nullptr)
         return ret;
 
-    Tile_Space & tile_space = world_map_[ind.quad_index][ind.z_][ind.y_][ind.x_];
+    Tile_Space & tile_space = chunk->cells_[Grid_Chunk::cell_offset(ind)];
+    uint32_t prev_size = tile_space.Size();
 
     if (items.Empty())
         tile_space.Clear();
     else
     {
         for (auto & item : items)
-            ret = ret || tile_space.Remove(item);
+            ret = tile_space.Remove(item) || ret;
+    }
+
+    if (prev_size == tile_space.Size())
+        return ret;
+
+    stats_.item_count_ -= prev_size - tile_space.Size();
+    ++chunk->revision_;
+    ++revision_;
+    if (tile_space.Empty())
+    {
+        --stats_.occupied_cells_;
+        --chunk->occupied_;
     }
 
     return ret;
@@ -436,6 +814,7 @@ Urho3D::Vector<int> Hex_Tile_Grid::remove(const Urho3D::Vector<ivec3> & pSpaces,
                                           const fvec3 & origin,
                                           const Urho3D::Vector<Tile_Item> & items)
 {
+    Op_Scope scope(this, GRID_OP_REMOVE);
     Urho3D::Vector<int> ret;
     for (uint32_t i = 0; i < pSpaces.Size(); ++i)
     {
@@ -447,22 +826,40 @@ Urho3D::Vector<int> Hex_Tile_Grid::remove(const Urho3D::Vector<ivec3> & pSpaces,
 
 void Hex_Tile_Grid::id_change(const Tile_Item & oldid, const Tile_Item newid)
 {
-    // Go through entire grid and remove any entrees with entity ID equal to above
-    Grid_Bounds g;
-    for (uint32_t i = 0; i < QUADRANT_COUNT; ++i)
+    // Go through entire grid and replace any entrees with entity ID equal to above
+    for (uint32_t i = 0; i < chunks_.Size(); ++i)
     {
-        for (uint32_t z = 0; z < world_map_[i].Size(); ++z)
+        Grid_Chunk * chunk = chunks_[i];
+        if (chunk->occupied_ == 0)
+            continue;
+
+        for (uint32_t c = 0; c < GRID_CHUNK_CELLS; ++c)
         {
-            for (uint32_t y = 0; y < world_map_[i][z].Size(); ++y)
-            {
-                for (uint32_t x = 0; x < world_map_[i][z][y].Size(); ++x)
-                {
-                    world_map_[i][z][y][x].Remove(oldid);
-                    world_map_[i][z][y][x].Push(newid);
-                }
-            }
+            Tile_Space & tile_space = chunk->cells_[c];
+            auto found = tile_space.Find(oldid);
+            if (found == tile_space.End())
+                continue;
+
+            // The replacement keeps the old item's active state - renaming must not reactivate a disabled occupier
+            Tile_Item replacement(newid.node_id_, found->active_);
+            tile_space.Erase(found);
+            ++chunk->revision_;
+            ++revision_;
+            if (tile_space.Contains(replacement))
+                --stats_.item_count_;
+            else
+                tile_space.Push(replacement);
         }
     }
+
+    // Occupiers registered under the old id have to be taken out under the new one
+    auto occ_iter = scene_occ_comps_.Begin();
+    while (occ_iter != scene_occ_comps_.End())
+    {
+        if (occ_iter->second_.node_id_ == oldid.node_id_)
+            occ_iter->second_.node_id_ = newid.node_id_;
+        ++occ_iter;
+    }
 }
 
 void Hex_Tile_Grid::OnSceneSet(Urho3D::Scene * scene)
@@ -474,6 +871,8 @@ void Hex_Tile_Grid::OnSceneSet(Urho3D::Scene * scene)
     }
 
     Component::OnSceneSet(scene);
+    if (scene == nullptr)
+        return;
 
     PODVector<Node *> node_vec;
     scene->GetChildrenWithComponent<Tile_Occupier>(node_vec, true);
@@ -484,6 +883,7 @@ void Hex_Tile_Grid::OnSceneSet(Urho3D::Scene * scene)
 Urho3D::Vector<Hex_Tile_Grid::Tile_Space> Hex_Tile_Grid::bounded_set(const fvec3 & pPoint1,
                                                                      const fvec3 & pPoint2)
 {
+    Op_Scope scope(this, GRID_OP_REGION);
     Urho3D::Vector<Tile_Space> retSet;
     fvec3 min(pPoint1);
     fvec3 max(pPoint2);
@@ -518,7 +918,7 @@ Urho3D::Vector<Hex_Tile_Grid::Tile_Space> Hex_Tile_Grid::bounded_set(const fvec3
             for (; minGrid.x_ <= maxGrid.x_; ++minGrid.x_)
             {
                 Map_Index ind = grid_to_index(minGrid);
-                const Tile_Space & id = _get_id(ind);
+                Tile_Space id = _active_items(_get_id(ind));
                 if (id.Empty())
                     continue;
                 retSet.Push(id);
@@ -578,7 +978,7 @@ Hex_Tile_Grid::Map_Index Hex_Tile_Grid::grid_to_index(const ivec3 & space)
 
 fvec3 Hex_Tile_Grid::grid_to_world(const ivec3 & space, const fvec3 & origin)
 {
-    ivec3 adjusted_space = space + world_to_grid(origin);
+    ivec3 adjusted_space = space_cell(space, world_to_grid(origin));
     fvec3 pos(
         adjusted_space.x_ * 2.0f * X_GRID, adjusted_space.y_ * Y_GRID, adjusted_space.z_ * Z_GRID);
     if (adjusted_space.y_ % 2 != 0)
@@ -586,6 +986,39 @@ fvec3 Hex_Tile_Grid::grid_to_world(const ivec3 & space, const fvec3 & origin)
     return pos;
 }
 
+ivec3 Hex_Tile_Grid::offset_to_axial(const ivec3 & grid)
+{
+    return ivec3(grid.x_ - (grid.y_ - (grid.y_ & 1)) / 2, grid.y_, grid.z_);
+}
+
+ivec3 Hex_Tile_Grid::axial_to_offset(const ivec3 & axial)
+{
+    return ivec3(axial.x_ + (axial.y_ - (axial.y_ & 1)) / 2, axial.y_, axial.z_);
+}
+
+ivec3 Hex_Tile_Grid::space_cell(const ivec3 & space, const ivec3 & origin_cell)
+{
+    // Adding offset coords directly would shift every odd row space by half a cell when the origin is on an odd row
+    return axial_to_offset(offset_to_axial(origin_cell) + offset_to_axial(space));
+}
+
+ivec3 Hex_Tile_Grid::rotate_cell(const ivec3 & grid, int steps, const ivec3 & pivot)
+{
+    steps = ((steps % 6) + 6) % 6;
+    if (steps == 0)
+        return grid;
+
+    // Rotating in cube coords is just a shuffle and negate of (q, r, s) - offset coords have to go through axial first
+    ivec3 ax_pivot = offset_to_axial(pivot);
+    ivec3 ax = offset_to_axial(grid) - ax_pivot;
+    for (int i = 0; i < steps; ++i)
+    {
+        int s = -ax.x_ - ax.y_;
+        ax = ivec3(-ax.y_, -s, ax.z_);
+    }
+    return axial_to_offset(ax + ax_pivot);
+}
+
 ivec3 Hex_Tile_Grid::index_to_grid(const Map_Index & pIndex)
 {
     ivec3 grid;
@@ -608,6 +1041,79 @@ ivec3 Hex_Tile_Grid::index_to_grid(const Map_Index & pIndex)
     return grid;
 }
 
+ivec3 Hex_Tile_Grid::chunk_key(const ivec3 & grid)
+{
+    Map_Index ind = grid_to_index(grid);
+    ind.x_ -= ind.x_ % GRID_CHUNK_DIM;
+    ind.y_ -= ind.y_ % GRID_CHUNK_DIM;
+    ind.z_ -= ind.z_ % GRID_CHUNK_DIM;
+    return index_to_grid(ind);
+}
+
+int32_t Hex_Tile_Grid::hex_distance(const ivec3 & from, const ivec3 & to)
+{
+    ivec3 d = offset_to_axial(to) - offset_to_axial(from);
+    return (Abs(d.x_) + Abs(d.y_) + Abs(d.x_ + d.y_)) / 2;
+}
+
+ivec3 Hex_Tile_Grid::neighbour(const ivec3 & grid, int dir)
+{
+    // Axial steps 60 degrees apart starting along +x
+    static const ivec3 axial_steps[GRID_PLANAR_NEIGHBOURS] = {
+        ivec3(1, 0, 0), ivec3(0, 1, 0), ivec3(-1, 1, 0), ivec3(-1, 0, 0), ivec3(0, -1, 0), ivec3(1, -1, 0)};
+
+    if (dir == GRID_NEIGHBOUR_UP)
+        return grid + ivec3(0, 0, 1);
+    if (dir == GRID_NEIGHBOUR_DOWN)
+        return grid + ivec3(0, 0, -1);
+    return axial_to_offset(offset_to_axial(grid) + axial_steps[dir]);
+}
+
+Urho3D::PODVector<ivec3> Hex_Tile_Grid::cells_in_radius(const ivec3 & center, int32_t radius)
+{
+    PODVector<ivec3> ret;
+    ivec3 ax_center = offset_to_axial(center);
+    for (int32_t q = -radius; q <= radius; ++q)
+    {
+        int32_t r_begin = Max(-radius, -q - radius);
+        int32_t r_end = Min(radius, -q + radius);
+        for (int32_t r = r_begin; r <= r_end; ++r)
+            ret.Push(axial_to_offset(ax_center + ivec3(q, r, 0)));
+    }
+    return ret;
+}
+
+Urho3D::PODVector<ivec3> Hex_Tile_Grid::cells_on_line(const ivec3 & from, const ivec3 & to)
+{
+    PODVector<ivec3> ret;
+    int32_t steps = hex_distance(from, to);
+    ivec3 ax_from = offset_to_axial(from);
+    ivec3 ax_to = offset_to_axial(to);
+    for (int32_t i = 0; i <= steps; ++i)
+    {
+        // Nudge off the exact cell edges so ties always round the same way
+        float t = (steps == 0) ? 0.0f : float(i) / float(steps);
+        float q = Lerp(float(ax_from.x_), float(ax_to.x_), t) + 1e-4f;
+        float r = Lerp(float(ax_from.y_), float(ax_to.y_), t) + 1e-4f;
+        float s = -q - r;
+
+        // Round in cube coords and fix up whichever component was rounded the furthest
+        float rq = std::round(q);
+        float rr = std::round(r);
+        float rs = std::round(s);
+        float dq = Abs(rq - q);
+        float dr = Abs(rr - r);
+        float ds = Abs(rs - s);
+        if (dq > dr && dq > ds)
+            rq = -rr - rs;
+        else if (dr > ds)
+            rr = -rq - rs;
+
+        ret.Push(axial_to_offset(ivec3(int32_t(rq), int32_t(rr), from.z_)));
+    }
+    return ret;
+}
+
 fvec3 Hex_Tile_Grid::index_to_world(const Map_Index & pIndex)
 {
     return grid_to_world(index_to_grid(pIndex));
@@ -636,58 +1142,247 @@ ivec3 Hex_Tile_Grid::world_to_grid(const fvec3 & pWorldPos)
 
 bool Hex_Tile_Grid::_check_bounds(const Map_Index & pIndex) const
 {
-    if (pIndex.z_ >= world_map_[pIndex.quad_index].Size())
-        return false;
+    return _chunk(pIndex) != nullptr;
+}
+
+Hex_Tile_Grid::Grid_Chunk * Hex_Tile_Grid::_chunk(const Map_Index & pIndex) const
+{
+    uint32_t cz = pIndex.z_ / GRID_CHUNK_DIM;
+    uint32_t cy = pIndex.y_ / GRID_CHUNK_DIM;
+    uint32_t cx = pIndex.x_ / GRID_CHUNK_DIM;
 
-    if (pIndex.y_ >= world_map_[pIndex.quad_index][pIndex.z_].Size())
-        return false;
+    if (cz >= world_map_[pIndex.quad_index].Size())
+        return nullptr;
 
-    if (pIndex.x_ >= world_map_[pIndex.quad_index][pIndex.z_][pIndex.y_].Size())
-        return false;
+    if (cy >= world_map_[pIndex.quad_index][cz].Size())
+        return nullptr;
 
-    return true;
+    if (cx >= world_map_[pIndex.quad_index][cz][cy].Size())
+        return nullptr;
+
+    return world_map_[pIndex.quad_index][cz][cy][cx];
+}
+
+Hex_Tile_Grid::Grid_Chunk * Hex_Tile_Grid::_acquire_chunk(const Map_Index & pIndex)
+{
+    Grid_Chunk * chunk = _chunk(pIndex);
+    if (chunk != nullptr)
+        return chunk;
+
+    uint32_t cz = pIndex.z_ / GRID_CHUNK_DIM;
+    uint32_t cy = pIndex.y_ / GRID_CHUNK_DIM;
+    uint32_t cx = pIndex.x_ / GRID_CHUNK_DIM;
+
+    // Either the chunk tables are too small or the chunk has never been written to
+    if (cz >= world_map_[pIndex.quad_index].Size() || cy >= world_map_[pIndex.quad_index][cz].Size() ||
+        cx >= world_map_[pIndex.quad_index][cz][cy].Size())
+        _resize_for_space(pIndex);
+
+    chunk = Chunk_Pool_Type::instance().acquire();
+    chunk->index_ = Map_Index(pIndex.quad_index, cx * GRID_CHUNK_DIM, cy * GRID_CHUNK_DIM, cz * GRID_CHUNK_DIM);
+    world_map_[pIndex.quad_index][cz][cy][cx] = chunk;
+    chunks_.Push(chunk);
+
+    _recount_allocation();
+    return chunk;
 }
 
 void Hex_Tile_Grid::_resize_for_space(const Map_Index & pIndex)
 {
+    const uint32_t default_chunks = DEFAULT_GRID_SIZE / GRID_CHUNK_DIM;
+    const uint32_t pad_chunks = TILE_GRID_RESIZE_PAD / GRID_CHUNK_DIM;
+
+    uint32_t cz = pIndex.z_ / GRID_CHUNK_DIM;
+    uint32_t cy = pIndex.y_ / GRID_CHUNK_DIM;
+    uint32_t cx = pIndex.x_ / GRID_CHUNK_DIM;
+
     uint32_t old_size = 0;
     uint32_t new_size = 0;
 
-    old_size = world_map_[pIndex.quad_index].Size();
-    if (pIndex.z_ >= old_size)
+    Map_Quadrant & quad = world_map_[pIndex.quad_index];
+    old_size = quad.Size();
+    if (cz >= old_size)
     {
-        new_size = pIndex.z_ + TILE_GRID_RESIZE_PAD;
-        world_map_[pIndex.quad_index].Resize(new_size);
-        iout << "Resizing tile grid z layer from" << old_size << "to" << new_size;
+        new_size = cz + pad_chunks;
+        quad.Resize(new_size);
+        iout << "Resizing tile grid z layer from" << old_size * GRID_CHUNK_DIM << "to" << new_size * GRID_CHUNK_DIM;
+        ++stats_.resize_count_;
 
         //Resize the x and y dimensions for all new layers
-        for (uint32_t i = old_size - 1; i < new_size; ++i)
+        for (uint32_t i = old_size; i < new_size; ++i)
         {
-            world_map_[pIndex.quad_index][i].Resize(DEFAULT_GRID_SIZE);
-            for (uint32_t j = 0; j < DEFAULT_GRID_SIZE; ++j)
-                world_map_[pIndex.quad_index][i][j].Resize(DEFAULT_GRID_SIZE);
+            quad[i].Resize(default_chunks);
+            for (uint32_t j = 0; j < default_chunks; ++j)
+            {
+                quad[i][j].Resize(default_chunks);
+                for (uint32_t k = 0; k < default_chunks; ++k)
+                    quad[i][j][k] = nullptr;
+            }
         }
     }
 
-    old_size = world_map_[pIndex.quad_index][pIndex.z_].Size();
-    if (pIndex.y_ >= old_size)
+    old_size = quad[cz].Size();
+    if (cy >= old_size)
     {
-        new_size = pIndex.y_ + TILE_GRID_RESIZE_PAD;
-        world_map_[pIndex.quad_index][pIndex.z_].Resize(new_size);
-        iout << "Resizing tile grid y layer from" << old_size << "to" << new_size;
+        new_size = cy + pad_chunks;
+        quad[cz].Resize(new_size);
+        iout << "Resizing tile grid y layer from" << old_size * GRID_CHUNK_DIM << "to" << new_size * GRID_CHUNK_DIM;
+        ++stats_.resize_count_;
 
         // Resize all the x dimensions for the current layer/row
-        for (uint32_t i = old_size - 1; i < new_size; ++i)
-            world_map_[pIndex.quad_index][pIndex.z_][i].Resize(DEFAULT_GRID_SIZE);
+        for (uint32_t i = old_size; i < new_size; ++i)
+        {
+            quad[cz][i].Resize(default_chunks);
+            for (uint32_t k = 0; k < default_chunks; ++k)
+                quad[cz][i][k] = nullptr;
+        }
+    }
+
+    Chunk_Row & row = quad[cz][cy];
+    old_size = row.Size();
+    if (cx >= old_size)
+    {
+        new_size = cx + pad_chunks;
+        row.Resize(new_size);
+        iout << "Resizing tile grid x layer from" << old_size * GRID_CHUNK_DIM << "to" << new_size * GRID_CHUNK_DIM;
+        ++stats_.resize_count_;
+        for (uint32_t i = old_size; i < new_size; ++i)
+            row[i] = nullptr;
+    }
+
+    _recount_allocation();
+}
+
+void Hex_Tile_Grid::_recount_allocation()
+{
+    uint32_t slots = 0;
+    uint32_t rows = 0;
+    uint32_t layers = 0;
+    for (uint32_t i = 0; i < world_map_.Size(); ++i)
+    {
+        layers += world_map_[i].Size();
+        for (uint32_t z = 0; z < world_map_[i].Size(); ++z)
+        {
+            rows += world_map_[i][z].Size();
+            for (uint32_t y = 0; y < world_map_[i][z].Size(); ++y)
+                slots += world_map_[i][z][y].Capacity();
+        }
+    }
+    stats_.allocated_cells_ = chunks_.Size() * GRID_CHUNK_CELLS;
+    stats_.chunk_count_ = chunks_.Size();
+    stats_.bytes_allocated_ = uint64_t(chunks_.Size()) * sizeof(Grid_Chunk) + uint64_t(slots) * sizeof(Grid_Chunk *) +
+                              uint64_t(rows) * sizeof(Chunk_Row) + uint64_t(layers) * sizeof(Map_Layer) +
+                              world_map_.Size() * sizeof(Map_Quadrant);
+}
+
+Hex_Tile_Grid::Grid_Stats Hex_Tile_Grid::stats() const
+{
+    // Item storage lives in the cells' own vectors so add it on top of the cell storage when asked
+    Grid_Stats ret(stats_);
+    ret.bytes_allocated_ += uint64_t(stats_.item_count_) * sizeof(Tile_Item);
+    return ret;
+}
+
+void Hex_Tile_Grid::reset_op_stats()
+{
+    for (int i = 0; i < GRID_OP_COUNT; ++i)
+        stats_.ops_[i] = Grid_Op_Stats();
+    stats_.resize_count_ = 0;
+}
+
+const char * Hex_Tile_Grid::op_name(Grid_Op op)
+{
+    switch (op)
+    {
+    case (GRID_OP_ADD):
+        return "add";
+    case (GRID_OP_REMOVE):
+        return "remove";
+    case (GRID_OP_OCCUPIED):
+        return "occupied";
+    case (GRID_OP_REGION):
+        return "region";
+    default:
+        return "unknown";
+    }
+}
+
+Urho3D::String Hex_Tile_Grid::stats_string() const
+{
+    Grid_Stats st = stats();
+    String ret;
+    ret.AppendWithFormat("Grid memory: %.2f KB in %u chunks\n", double(st.bytes_allocated_) / 1024.0, st.chunk_count_);
+    ret.AppendWithFormat("Grid cells: %u occupied / %u allocated (%u items)\n",
+                         st.occupied_cells_,
+                         st.allocated_cells_,
+                         st.item_count_);
+    ret.AppendWithFormat("Grid resizes: %u\n", st.resize_count_);
+    Chunk_Pool_Type & pool = Chunk_Pool_Type::instance();
+    ret.AppendWithFormat("Grid chunk pool: %u allocated %u shared free\n", pool.allocated_count(), pool.shared_free_count());
+    ret.AppendWithFormat("Grid footprints: %u unique", Tile_Footprint::unique_count());
+    if (!op_profiling_)
+    {
+        ret.Append("\nGrid ops: not profiled (profile on)");
+        return ret;
+    }
+
+    for (int i = 0; i < GRID_OP_COUNT; ++i)
+    {
+        const Grid_Op_Stats & ops = st.ops_[i];
+        ret.AppendWithFormat("\nGrid %s: %u calls %.3f ms",
+                             op_name(Grid_Op(i)),
+                             uint32_t(ops.calls_),
+                             double(ops.total_usec_) / 1000.0);
+    }
+    return ret;
+}
+
+void Hex_Tile_Grid::push_hud_stats(Urho3D::DebugHud * hud)
+{
+    if (hud == nullptr || hud->GetMode() == 0)
+        return;
+
+    // Op timings are only shown once the profile console command has turned them on - the HUD never does so itself
+    Vector<String> lines = stats_string().Split('\n');
+    for (uint32_t i = 0; i < lines.Size(); ++i)
+    {
+        unsigned split = lines[i].Find(':');
+        hud->SetAppStats(lines[i].Substring(0, split), lines[i].Substring(split + 2));
     }
+}
+
+void Hex_Tile_Grid::set_op_profiling(bool enable)
+{
+    op_profiling_ = enable;
+}
+
+bool Hex_Tile_Grid::op_profiling() const
+{
+    return op_profiling_;
+}
 
-    old_size = world_map_[pIndex.quad_index][pIndex.z_][pIndex.y_].Size();
-    if (pIndex.x_ >= old_size)
+Urho3D::JSONValue Hex_Tile_Grid::stats_json() const
+{
+    Grid_Stats st = stats();
+    JSONValue ret;
+    ret.Set("bytes_allocated", JSONValue(double(st.bytes_allocated_)));
+    ret.Set("allocated_cells", JSONValue(st.allocated_cells_));
+    ret.Set("occupied_cells", JSONValue(st.occupied_cells_));
+    ret.Set("item_count", JSONValue(st.item_count_));
+    ret.Set("chunk_count", JSONValue(st.chunk_count_));
+    ret.Set("resize_count", JSONValue(st.resize_count_));
+    ret.Set("unique_footprints", JSONValue(Tile_Footprint::unique_count()));
+
+    JSONValue ops;
+    for (int i = 0; i < GRID_OP_COUNT; ++i)
     {
-        new_size = pIndex.x_ + TILE_GRID_RESIZE_PAD;
-        world_map_[pIndex.quad_index][pIndex.z_][pIndex.y_].Resize(new_size);
-        iout << "Resizing tile grid x layer from" << old_size << "to" << new_size;
+        JSONValue op;
+        op.Set("calls", JSONValue(double(st.ops_[i].calls_)));
+        op.Set("total_ms", JSONValue(double(st.ops_[i].total_usec_) / 1000.0));
+        ops.Set(op_name(Grid_Op(i)), op);
     }
+    ret.Set("ops", ops);
+    return ret;
 }
 
 void Hex_Tile_Grid::register_context(Urho3D::Context * context)
@@ -698,7 +1393,7 @@ void Hex_Tile_Grid::register_context(Urho3D::Context * context)
 
 const Hex_Tile_Grid::Tile_Space & Hex_Tile_Grid::_get_id(const Map_Index & pIndex)
 {
-    return world_map_[pIndex.quad_index][pIndex.z_][pIndex.y_][pIndex.x_];
+    return at(pIndex);
 }
 
 void Hex_Tile_Grid::handle_component_added(Urho3D::StringHash eventType,
@@ -708,7 +1403,12 @@ void Hex_Tile_Grid::handle_component_added(Urho3D::StringHash eventType,
     if (GetScene() != scn)
         return;
     Component * comp = static_cast<Component *>(eventData[ComponentRemoved::P_COMPONENT].GetPtr());
-    if (comp->IsInstanceOf<Tile_Occupier>())
+    if (!comp->IsInstanceOf<Tile_Occupier>())
+        return;
+
+    if (batch_depth_ > 0)
+        batch_added_.Push(static_cast<Tile_Occupier *>(comp));
+    else
         _add_component(static_cast<Tile_Occupier *>(comp));
 }
 
@@ -723,59 +1423,408 @@ void Hex_Tile_Grid::handle_component_removed(Urho3D::StringHash eventType,
         _remove_component(static_cast<Tile_Occupier *>(comp));
 }
 
-void Hex_Tile_Grid::_add_component(Tile_Occupier * occ)
+void Hex_Tile_Grid::handle_console_command(Urho3D::StringHash event_type, Urho3D::VariantMap & event_data)
+{
+    using namespace ConsoleCommand;
+
+    // Only handle commands when the console interpreter is set to us
+    if (event_data[P_ID].GetString() != GetTypeName())
+        return;
+
+    Vector<String> args = event_data[P_COMMAND].GetString().Split(' ');
+    if (args.Empty())
+        return;
+
+    if (args[0] == "stats")
+    {
+        iout << stats_string();
+    }
+    else if (args[0] == "stats_json")
+    {
+        JSONFile json(context_);
+        json.GetRoot() = stats_json();
+        if (args.Size() < 2)
+            iout << json.ToString("  ");
+        else if (json.SaveFile(args[1]))
+            iout << "Saved tile grid stats to" << args[1];
+        else
+            eout << "Could not save tile grid stats to" << args[1];
+    }
+    else if (args[0] == "stats_reset")
+    {
+        reset_op_stats();
+    }
+    else if (args[0] == "profile" && args.Size() > 1)
+    {
+        set_op_profiling(args[1] == "on");
+    }
+    else if (args[0] == "debug_mode" && args.Size() > 1)
+    {
+        set_debug_draw_mode(args[1] == "all" ? DEBUG_DRAW_ALL_CELLS : DEBUG_DRAW_VISIBLE_CHUNKS);
+    }
+    else
+    {
+        iout << "Tile grid commands: stats, stats_json [file], stats_reset, profile [on|off], debug_mode "
+                "[all|visible]";
+    }
+}
+
+void Hex_Tile_Grid::handle_post_update(Urho3D::StringHash event_type, Urho3D::VariantMap & event_data)
 {
-    scene_occ_comps_.Insert(occ);
-    add(Tile_Item(occ->GetNode()->GetID()), occ->tile_spaces(), occ->GetNode()->GetPosition());
+    flush_updates();
 }
 
-void Hex_Tile_Grid::_remove_component(Tile_Occupier * occ)
+void Hex_Tile_Grid::set_deferred_updates(bool enable)
 {
-    scene_occ_comps_.Erase(occ);
-    fvec3 fpos = occ->GetNode()->GetPosition();
-    remove(occ->tile_spaces(), fpos, Tile_Item(occ->GetNode()->GetID()));
+    if (!enable)
+        flush_updates();
+    deferred_ = enable;
 }
 
-void Hex_Tile_Grid::DrawDebugGeometry(bool depth)
+bool Hex_Tile_Grid::deferred_updates() const
 {
-    Scene * scn = GetScene();
-    if (scn == nullptr)
+    return deferred_;
+}
+
+/*!
+Called by occupiers when their node is marked dirty. In deferred mode the occupier is only queued - however many times
+it moves during the frame its spaces are moved once in flush_updates.
+*/
+void Hex_Tile_Grid::occupier_moved(Tile_Occupier * occ)
+{
+    if (moves_suppressed_)
         return;
 
-    DebugRenderer * deb = scn->GetComponent<DebugRenderer>();
-    if (deb == nullptr)
+    if (batch_depth_ > 0)
+        batch_moved_.Push(occ);
+    else if (deferred_)
+        dirty_occs_.Insert(occ);
+    else
+        update_occupier(occ);
+}
+
+void Hex_Tile_Grid::begin_batch()
+{
+    ++batch_depth_;
+}
+
+void Hex_Tile_Grid::end_batch()
+{
+    if (batch_depth_ == 0 || --batch_depth_ > 0)
         return;
 
-    for (uint32_t i = 0; i < QUADRANT_COUNT; ++i)
+    for (uint32_t i = 0; i < batch_added_.Size(); ++i)
     {
-        for (uint32_t z = 0; z < world_map_[i].Size(); ++z)
+        if (!scene_occ_comps_.Contains(batch_added_[i]))
+            _add_component(batch_added_[i]);
+    }
+    batch_added_.Clear();
+
+    for (uint32_t i = 0; i < batch_moved_.Size(); ++i)
+        dirty_occs_.Insert(batch_moved_[i]);
+    batch_moved_.Clear();
+
+    if (!deferred_)
+        flush_updates();
+}
+
+void Hex_Tile_Grid::set_moves_suppressed(bool suppress)
+{
+    moves_suppressed_ = suppress;
+}
+
+bool Hex_Tile_Grid::moves_suppressed() const
+{
+    return moves_suppressed_;
+}
+
+void Hex_Tile_Grid::occupiers_moved(const Urho3D::PODVector<Tile_Occupier *> & occs)
+{
+    if (batch_depth_ > 0)
+    {
+        batch_moved_.Push(occs);
+        return;
+    }
+
+    for (uint32_t i = 0; i < occs.Size(); ++i)
+        dirty_occs_.Insert(occs[i]);
+    if (!deferred_)
+        flush_updates();
+}
+
+void Hex_Tile_Grid::flush_updates()
+{
+    if (dirty_occs_.Empty())
+        return;
+
+    auto iter = dirty_occs_.Begin();
+    while (iter != dirty_occs_.End())
+    {
+        update_occupier(*iter);
+        ++iter;
+    }
+    dirty_occs_.Clear();
+}
+
+/*!
+Move the occupier's spaces from where they are registered to the node's current world position and rotation - nothing
+is touched if the node is still in the same cell and 60 degree step. A rotation swaps in the occupier's cached rotated
+footprint rather than rotating the spaces.
+*/
+void Hex_Tile_Grid::update_occupier(Tile_Occupier * occ)
+{
+    auto iter = scene_occ_comps_.Find(occ);
+    if (iter == scene_occ_comps_.End())
+        return;
+
+    // Inactive occupiers still have to follow their node so their items are in the right cells when reactivated
+    Node * node = occ->GetNode();
+    fvec3 new_origin = node->GetWorldPosition();
+    int step = Tile_Footprint::rotation_step(node->GetWorldRotation());
+    bool rotated = (step != occ->rotation_step());
+    if (rotated || world_to_grid(new_origin) != world_to_grid(iter->second_.origin_))
+    {
+        Tile_Item item(iter->second_.node_id_, occ->IsEnabled());
+        remove(occ->tile_spaces(), iter->second_.origin_, item);
+        if (rotated)
+            occ->_apply_rotation_step(step);
+        add(item, occ->tile_spaces(), new_origin);
+        if (occ->debug_enabled())
+            occ_debug_dirty_ = true;
+    }
+    iter->second_.origin_ = new_origin;
+}
+
+fvec3 Hex_Tile_Grid::occupier_origin(Tile_Occupier * occ) const
+{
+    auto iter = scene_occ_comps_.Find(occ);
+    if (iter == scene_occ_comps_.End())
+        return occ->GetNode()->GetWorldPosition();
+    return iter->second_.origin_;
+}
+
+void Hex_Tile_Grid::register_occupier(Tile_Occupier * occ)
+{
+    if (occ != nullptr && !scene_occ_comps_.Contains(occ))
+        _add_component(occ);
+}
+
+void Hex_Tile_Grid::unregister_occupier(Tile_Occupier * occ)
+{
+    if (occ != nullptr)
+        _remove_component(occ);
+}
+
+void Hex_Tile_Grid::unregister_occupiers(const Urho3D::PODVector<Tile_Occupier *> & occs)
+{
+    Op_Scope scope(this, GRID_OP_REMOVE);
+    for (uint32_t i = 0; i < occs.Size(); ++i)
+    {
+        if (occs[i] != nullptr)
+            _remove_component(occs[i]);
+    }
+}
+
+bool Hex_Tile_Grid::occupier_registered(Tile_Occupier * occ) const
+{
+    return scene_occ_comps_.Contains(occ);
+}
+
+void Hex_Tile_Grid::set_occupier_active(Tile_Occupier * occ, bool active)
+{
+    auto iter = scene_occ_comps_.Find(occ);
+    if (iter == scene_occ_comps_.End())
+        return;
+
+    Tile_Item item(iter->second_.node_id_);
+    ivec3 origin_cell = world_to_grid(iter->second_.origin_);
+    const Vector<ivec3> & spaces = occ->tile_spaces();
+    for (uint32_t i = 0; i < spaces.Size(); ++i)
+    {
+        Map_Index ind = grid_to_index(space_cell(spaces[i], origin_cell));
+        Grid_Chunk * chunk = _chunk(ind);
+        if (chunk == nullptr)
+            continue;
+
+        Tile_Space & cell = chunk->cells_[Grid_Chunk::cell_offset(ind)];
+        auto found = cell.Find(item);
+        if (found != cell.End() && found->active_ != active)
         {
-            for (uint32_t y = 0; y < world_map_[i][z].Size(); ++y)
-            {
-                for (uint32_t x = 0; x < world_map_[i][z][y].Size(); ++x)
-                {
-                    for (int item_ind = 0; item_ind < world_map_[i][z][y][x].Size(); ++item_ind)
-                    {
-                        BoundingBox bb;
-                        Map_Index ind;
-
-                        float mod = -1.0f * (item_ind % 2);
-                        fvec3 pos = index_to_world(Map_Index(i, x, y, z)) +
-                                    fvec3(mod * 0.1f, mod * 0.1f, 0.0f);
-                        bb.min_ = fvec3(-0.25f, -0.25f, -0.15f) + pos;
-                        bb.max_ = fvec3(0.25f, 0.25f, 0.15f) + pos;
-                        deb->AddBoundingBox(bb, Color(1.0f, 0.0f, 0.0f), depth, false);
-                    }
-                }
-            }
+            found->active_ = active;
+            ++chunk->revision_;
+            ++revision_;
+        }
+    }
+
+    if (occ->debug_enabled())
+        occ_debug_dirty_ = true;
+}
+
+void Hex_Tile_Grid::_add_component(Tile_Occupier * occ)
+{
+    // Occupiers absorbed in to a compound are covered by the root's footprint
+    if (occ->compound_root() != nullptr)
+        return;
+
+    Occupier_Entry & entry = scene_occ_comps_[occ];
+    entry.origin_ = occ->GetNode()->GetWorldPosition();
+    entry.node_id_ = occ->GetNode()->GetID();
+    occ->grid_ = this;
+    add(Tile_Item(entry.node_id_, occ->IsEnabled()), occ->tile_spaces(), entry.origin_);
+    if (occ->debug_enabled())
+        occ_debug_dirty_ = true;
+}
+
+void Hex_Tile_Grid::_remove_component(Tile_Occupier * occ)
+{
+    // Forget any batched adds or moves even if the occupier never made it in to the grid
+    if (batch_depth_ > 0)
+    {
+        batch_added_.Remove(occ);
+        for (int i = int(batch_moved_.Size()) - 1; i >= 0; --i)
+        {
+            if (batch_moved_[i] == occ)
+                batch_moved_.EraseSwap(i);
         }
     }
 
+    dirty_occs_.Erase(occ);
+    auto iter = scene_occ_comps_.Find(occ);
+    if (iter == scene_occ_comps_.End())
+        return;
+
+    remove(occ->tile_spaces(), iter->second_.origin_, Tile_Item(iter->second_.node_id_));
+    scene_occ_comps_.Erase(iter);
+    occ->grid_.Reset();
+    if (occ->debug_enabled())
+        occ_debug_dirty_ = true;
+}
+
+void Hex_Tile_Grid::set_debug_draw_mode(Debug_Draw_Mode mode)
+{
+    debug_mode_ = mode;
+    debug_cache_.Clear();
+}
+
+Hex_Tile_Grid::Debug_Draw_Mode Hex_Tile_Grid::debug_draw_mode() const
+{
+    return debug_mode_;
+}
+
+void Hex_Tile_Grid::invalidate_occupier_debug()
+{
+    occ_debug_dirty_ = true;
+}
+
+void Hex_Tile_Grid::_build_occupier_debug_lines()
+{
+    occ_debug_lines_.Clear();
+    float hs = OCC_DEBUG_CROSS_SIZE * 0.5f;
+
     auto occ_iter = scene_occ_comps_.Begin();
     while (occ_iter != scene_occ_comps_.End())
     {
-        if ((*occ_iter)->debug_enabled())
-            (*occ_iter)->DrawDebugGeometry(depth);
+        Tile_Occupier * occ = occ_iter->first_;
+        if (occ->debug_enabled() && occ->IsEnabled())
+        {
+            const Vector<ivec3> & spaces = occ->tile_spaces();
+            for (uint32_t i = 0; i < spaces.Size(); ++i)
+            {
+                fvec3 c = grid_to_world(spaces[i], occ_iter->second_.origin_);
+                occ_debug_lines_.Push(c - fvec3(hs, 0.0f, 0.0f));
+                occ_debug_lines_.Push(c + fvec3(hs, 0.0f, 0.0f));
+                occ_debug_lines_.Push(c - fvec3(0.0f, hs, 0.0f));
+                occ_debug_lines_.Push(c + fvec3(0.0f, hs, 0.0f));
+                occ_debug_lines_.Push(c - fvec3(0.0f, 0.0f, hs));
+                occ_debug_lines_.Push(c + fvec3(0.0f, 0.0f, hs));
+            }
+        }
         ++occ_iter;
     }
+    occ_debug_dirty_ = false;
+}
+
+Urho3D::BoundingBox Hex_Tile_Grid::chunk_world_bounds(const Grid_Chunk * chunk) const
+{
+    const uint32_t last = GRID_CHUNK_DIM - 1;
+    const Map_Index & ind = chunk->index_;
+    fvec3 first_corner = index_to_world(ind);
+    fvec3 last_corner = index_to_world(Map_Index(ind.quad_index, ind.x_ + last, ind.y_ + last, ind.z_ + last));
+
+    // Pad by a cell in each direction to cover the odd row offset and whatever is sitting in the edge cells
+    fvec3 pad(2.0f * X_GRID, Y_GRID, Z_GRID);
+    BoundingBox bb(first_corner, first_corner);
+    bb.Merge(last_corner);
+    bb.min_ -= pad;
+    bb.max_ += pad;
+    return bb;
+}
+
+void Hex_Tile_Grid::_build_debug_lines(const Grid_Chunk * chunk, Chunk_Debug_Cache & cache)
+{
+    cache.revision_ = chunk->revision_;
+    cache.lines_.Clear();
+    for (uint32_t c = 0; c < GRID_CHUNK_CELLS; ++c)
+    {
+        for (int item_ind = 0; item_ind < chunk->cells_[c].Size(); ++item_ind)
+        {
+            if (!chunk->cells_[c][item_ind].active_)
+                continue;
+
+            float mod = -1.0f * (item_ind % 2);
+            fvec3 pos = index_to_world(chunk->cell_index(c)) + fvec3(mod * 0.1f, mod * 0.1f, 0.0f);
+            fvec3 mn = fvec3(-0.25f, -0.25f, -0.15f) + pos;
+            fvec3 mx = fvec3(0.25f, 0.25f, 0.15f) + pos;
+
+            // Same twelve edges DebugRenderer::AddBoundingBox would add
+            fvec3 v1(mx.x_, mn.y_, mn.z_);
+            fvec3 v2(mx.x_, mx.y_, mn.z_);
+            fvec3 v3(mn.x_, mx.y_, mn.z_);
+            fvec3 v4(mn.x_, mn.y_, mx.z_);
+            fvec3 v5(mx.x_, mn.y_, mx.z_);
+            fvec3 v6(mn.x_, mx.y_, mx.z_);
+            const fvec3 edges[24] = {mn, v1, v1, v2, v2, v3, v3, mn, v4, v5, v5, mx,
+                                     mx, v6, v6, v4, mn, v4, v1, v5, v2, mx, v3, v6};
+            for (int e = 0; e < 24; ++e)
+                cache.lines_.Push(edges[e]);
+        }
+    }
+}
+
+void Hex_Tile_Grid::DrawDebugGeometry(bool depth)
+{
+    Scene * scn = GetScene();
+    if (scn == nullptr)
+        return;
+
+    DebugRenderer * deb = scn->GetComponent<DebugRenderer>();
+    if (deb == nullptr)
+        return;
+
+    unsigned col = Color(1.0f, 0.0f, 0.0f).ToUInt();
+    for (uint32_t i = 0; i < chunks_.Size(); ++i)
+    {
+        Grid_Chunk * chunk = chunks_[i];
+        if (chunk->occupied_ == 0)
+            continue;
+
+        if (debug_mode_ == DEBUG_DRAW_VISIBLE_CHUNKS && !deb->IsInside(chunk_world_bounds(chunk)))
+            continue;
+
+        // Only regenerate the lines for chunks that have changed since they were last drawn
+        Chunk_Debug_Cache & cache = debug_cache_[chunk];
+        if (cache.revision_ != chunk->revision_)
+            _build_debug_lines(chunk, cache);
+
+        for (uint32_t l = 0; l + 1 < cache.lines_.Size(); l += 2)
+            deb->AddLine(cache.lines_[l], cache.lines_[l + 1], col, depth);
+    }
+
+    // All occupier crosses go out as one cached line list rather than a cross per space per occupier
+    if (occ_debug_dirty_)
+        _build_occupier_debug_lines();
+
+    unsigned occ_col = Color(0.0f, 0.0f, 1.0f).ToUInt();
+    for (uint32_t l = 0; l + 1 < occ_debug_lines_.Size(); l += 2)
+        deb->AddLine(occ_debug_lines_[l], occ_debug_lines_[l + 1], occ_col, depth);
 }
@@ -6,14 +6,32 @@ const float Z_GRID = 0.45f;
 const int QUADRANT_COUNT = 8;
 const int DEFAULT_GRID_SIZE = 32;
 const int TILE_GRID_RESIZE_PAD = 8;
+const int GRID_CHUNK_DIM = 8;
+const int GRID_CHUNK_CELLS = GRID_CHUNK_DIM * GRID_CHUNK_DIM * GRID_CHUNK_DIM;
+// Cells of a released chunk keep item storage up to this many items - anything bigger goes back to the heap
+const unsigned GRID_CELL_KEEP_CAPACITY = 4;
+const float OCC_DEBUG_CROSS_SIZE = 1.0f;
+const float GRID_RAY_STEP = 0.5f * Z_GRID;
+const float GRID_RAY_MAX_DISTANCE = 1000.0f;
+// Directions for neighbour - the six planar neighbours 60 degrees apart starting along +x, then above and below
+const int GRID_PLANAR_NEIGHBOURS = 6;
+const int GRID_NEIGHBOUR_UP = 6;
+const int GRID_NEIGHBOUR_DOWN = 7;
+const int GRID_NEIGHBOUR_COUNT = 8;
 
 #include <Urho3D/Scene/Component.h>
+#include <Urho3D/Container/HashSet.h>
 #include <math_utils.h>
+#include <grid_chunk_pool.h>
 
 namespace Urho3D
 {
 class Scene;
 class Node;
+class JSONValue;
+class Ray;
+class Frustum;
+class DebugHud;
 } // namespace Urho3D
 
 class Tile_Occupier;
@@ -35,9 +53,10 @@ class Hex_Tile_Grid : public Urho3D::Component
         BOTTOM_LEFT_BACK
     };
 
+    // Items compare by node id only - inactive items stay in their cells but are skipped by every query
     struct Tile_Item
     {
-        Tile_Item(int node_id = -1) : node_id_(node_id)
+        Tile_Item(int node_id = -1, bool active = true) : node_id_(node_id), active_(active)
         {}
 
         bool operator==(const Tile_Item & rhs) const
@@ -51,6 +70,63 @@ class Hex_Tile_Grid : public Urho3D::Component
         }
 
         int node_id_;
+        bool active_;
+    };
+
+    enum Debug_Draw_Mode
+    {
+        DEBUG_DRAW_ALL_CELLS,
+        DEBUG_DRAW_VISIBLE_CHUNKS
+    };
+
+    enum Grid_Op
+    {
+        GRID_OP_ADD,
+        GRID_OP_REMOVE,
+        GRID_OP_OCCUPIED,
+        GRID_OP_REGION,
+        GRID_OP_COUNT
+    };
+
+    struct Grid_Op_Stats
+    {
+        Grid_Op_Stats() : calls_(0), total_usec_(0)
+        {}
+
+        uint64_t calls_;
+        int64_t total_usec_;
+    };
+
+    /// Live memory and operation counters
+    struct Grid_Stats
+    {
+        Grid_Stats()
+            : bytes_allocated_(0),
+              allocated_cells_(0),
+              occupied_cells_(0),
+              item_count_(0),
+              chunk_count_(0),
+              resize_count_(0)
+        {}
+
+        uint64_t bytes_allocated_;
+        uint32_t allocated_cells_;
+        uint32_t occupied_cells_;
+        uint32_t item_count_;
+        uint32_t chunk_count_;
+        uint32_t resize_count_;
+        Grid_Op_Stats ops_[GRID_OP_COUNT];
+    };
+
+    struct Grid_Ray_Hit
+    {
+        Grid_Ray_Hit() : distance_(0.0f)
+        {}
+
+        ivec3 cell_;
+        // First active item in the hit cell
+        Tile_Item item_;
+        float distance_;
     };
 
     struct Grid_Bounds
@@ -72,9 +148,60 @@ class Hex_Tile_Grid : public Urho3D::Component
     };
 
     using Tile_Space = Urho3D::Vector<Tile_Item>;
-    using Map_Layer = Urho3D::Vector<Urho3D::Vector<Tile_Space>>;
+
+    /*!
+    Fixed size block of GRID_CHUNK_DIM^3 cells - the unit the grid allocates in. Chunks come from a pool shared by
+    all grids and go back to it on release(). Each cell's items live in its own vector, so the first item placed in a
+    cell of a never used chunk still allocates - recycled chunks keep small cell capacity (see reset) and do not.
+    */
+    struct Grid_Chunk
+    {
+        Grid_Chunk() : occupied_(0), revision_(0), next_free_(nullptr)
+        {}
+
+        void reset();
+
+        static uint32_t cell_offset(const Map_Index & index_);
+
+        Map_Index cell_index(uint32_t offset) const;
+
+        Tile_Space cells_[GRID_CHUNK_CELLS];
+
+        // Index of the chunk's first cell
+        Map_Index index_;
+
+        uint32_t occupied_;
+
+        // Bumped every time an item is added to or removed from one of the cells
+        uint32_t revision_;
+
+        Grid_Chunk * next_free_;
+    };
+
+    using Chunk_Row = Urho3D::PODVector<Grid_Chunk *>;
+    using Map_Layer = Urho3D::Vector<Chunk_Row>;
     using Map_Quadrant = Urho3D::Vector<Map_Layer>;
     using Map_World = Urho3D::Vector<Map_Quadrant>;
+    using Chunk_Pool_Type = Chunk_Pool<Grid_Chunk>;
+
+    /// Line list (pairs of points) generated for a chunk the last time it was drawn at revision_ - a new cache starts
+    /// at a revision no chunk has so it is always built once, and an empty list is as valid as any other
+    struct Chunk_Debug_Cache
+    {
+        Chunk_Debug_Cache() : revision_(Urho3D::M_MAX_UNSIGNED)
+        {}
+
+        uint32_t revision_;
+        Urho3D::PODVector<fvec3> lines_;
+    };
+
+    /// Where a registered occupier's spaces are in the grid - the node id is kept since it is already reset by the
+    /// time an occupier hears it has left the scene
+    struct Occupier_Entry
+    {
+        fvec3 origin_;
+        int node_id_;
+    };
 
     Hex_Tile_Grid(Urho3D::Context * context);
 
@@ -104,9 +231,9 @@ class Hex_Tile_Grid : public Urho3D::Component
 
     Grid_Bounds occupied_bounds();
 
-    int32_t min_layer();
+    int32_t min_layer() const;
 
-    int32_t max_layer();
+    int32_t max_layer() const;
 
     int32_t min_y();
 
@@ -130,6 +257,36 @@ class Hex_Tile_Grid : public Urho3D::Component
              const fvec3 & origin = fvec3(),
              const Urho3D::Vector<Tile_Item> & allowed_items = Urho3D::Vector<Tile_Item>()) const;
 
+    // Whether an active item whose node id is not in excluded_ids is in the cell at grid_ - a hash lookup per item
+    // instead of a scan of an allowed list, for excluding large selections
+    bool occupied_excluding(const ivec3 & grid_, const Urho3D::HashSet<int> & excluded_ids) const;
+
+    // Highest z in the (x, y) column holding an active item - returns false and leaves top_z alone if there is none.
+    // Unallocated and empty chunks in the column are skipped without looking at their cells.
+    bool column_top(int32_t x, int32_t y, int32_t & top_z) const;
+
+    // The top cell with an active item of every occupied column - one pass over the allocated chunks. With within set
+    // only the columns of chunk stacks with a chunk inside the frustum are scanned.
+    Urho3D::PODVector<ivec3> column_tops(const Urho3D::Frustum * within = nullptr) const;
+
+    /*!
+    March ray through the allocated layers in GRID_RAY_STEP increments and return the first cell holding an active
+    item. This is a cell level test - the hit is wherever the ray enters the cell, not the surface of the model.
+    */
+    bool raycast(const Urho3D::Ray & ray, Grid_Ray_Hit & hit, float max_distance = GRID_RAY_MAX_DISTANCE) const;
+
+    // Bumped whenever an item is added, removed or toggled anywhere in the grid
+    uint32_t revision() const;
+
+    // Revision of every allocated chunk by chunk key - compare against a stored copy to find the chunks that changed
+    void chunk_revisions(Urho3D::HashMap<ivec3, uint32_t> & out) const;
+
+    // Ids of the nodes with an active item anywhere in the chunk
+    void chunk_node_ids(const ivec3 & key_, Urho3D::HashSet<int> & out) const;
+
+    // Cells of the chunk holding at least one active item
+    void chunk_occupied_cells(const ivec3 & key_, Urho3D::PODVector<ivec3> & out) const;
+
     bool remove(const fvec3 & pos, const Tile_Item & tile_item = Tile_Item());
 
     bool remove(const ivec3 & space,
@@ -168,6 +325,34 @@ class Hex_Tile_Grid : public Urho3D::Component
 
     static ivec3 index_to_grid(const Map_Index & index_);
 
+    // Grid coords of the first cell of the chunk holding grid_ - identifies the chunk
+    static ivec3 chunk_key(const ivec3 & grid_);
+
+    // Odd row offset grid coords to axial (x = q, y = r) and back - z is passed through
+    static ivec3 offset_to_axial(const ivec3 & grid_);
+
+    static ivec3 axial_to_offset(const ivec3 & axial_);
+
+    // The cell footprint space space_ lands on for an occupier whose origin is in origin_cell_. Spaces are offset
+    // coords laid out around an origin at cell (0, 0, 0) and are placed through axial coords so they keep their shape
+    // on every row.
+    static ivec3 space_cell(const ivec3 & space_, const ivec3 & origin_cell_);
+
+    // Rotate grid_ about pivot_ by steps * 60 degrees counter clockwise (looking down the z axis)
+    static ivec3 rotate_cell(const ivec3 & grid_, int steps, const ivec3 & pivot_ = ivec3());
+
+    // Number of hex steps between the two cells' columns - z is ignored
+    static int32_t hex_distance(const ivec3 & from_, const ivec3 & to_);
+
+    // The cell next to grid_ in direction dir (one of the GRID_NEIGHBOUR directions)
+    static ivec3 neighbour(const ivec3 & grid_, int dir);
+
+    // Every cell within radius_ hex steps of center_, on center_'s layer
+    static Urho3D::PODVector<ivec3> cells_in_radius(const ivec3 & center_, int32_t radius_);
+
+    // The cells a straight line from from_ to to_ passes through (both ends included), on from_'s layer
+    static Urho3D::PODVector<ivec3> cells_on_line(const ivec3 & from_, const ivec3 & to_);
+
     static fvec3 index_to_world(const Map_Index & index_);
 
     static void snap_to_grid(fvec3 & world_);
@@ -178,16 +363,98 @@ class Hex_Tile_Grid : public Urho3D::Component
 
     void handle_component_removed(Urho3D::StringHash event_type, Urho3D::VariantMap & event_data);
 
+    void handle_console_command(Urho3D::StringHash event_type, Urho3D::VariantMap & event_data);
+
+    void handle_post_update(Urho3D::StringHash event_type, Urho3D::VariantMap & event_data);
+
+    void set_deferred_updates(bool enable);
+
+    bool deferred_updates() const;
+
+    void occupier_moved(Tile_Occupier * occ);
+
+    /*!
+    Hold back occupier_moved calls and newly added occupiers until the matching end_batch. Added occupiers are then
+    registered with whatever footprint and position they ended up with, and moves are queued as one group (and applied
+    right away unless updates are deferred). Batches nest.
+    */
+    void begin_batch();
+
+    void end_batch();
+
+    // While suppressed occupier_moved does nothing - for moving many nodes at once without a grid call per node. The
+    // caller hands the moved occupiers over afterwards with occupiers_moved.
+    void set_moves_suppressed(bool suppress);
+
+    bool moves_suppressed() const;
+
+    // Queue every occupier in occs as moved in one go (and update them right away unless updates are deferred)
+    void occupiers_moved(const Urho3D::PODVector<Tile_Occupier *> & occs);
+
+    // Add or drop an occupier from the grid without the component being added or removed - used for compound occupiers
+    void register_occupier(Tile_Occupier * occ);
+
+    void unregister_occupier(Tile_Occupier * occ);
+
+    // Take a batch of occupiers out of the grid in one pass - used before deleting many nodes at once
+    void unregister_occupiers(const Urho3D::PODVector<Tile_Occupier *> & occs);
+
+    bool occupier_registered(Tile_Occupier * occ) const;
+
+    // Flip the active flag on the occupier's items in place - the spaces are not removed or re-added
+    void set_occupier_active(Tile_Occupier * occ, bool active);
+
+    void update_occupier(Tile_Occupier * occ);
+
+    void flush_updates();
+
+    fvec3 occupier_origin(Tile_Occupier * occ) const;
+
     void id_change(const Tile_Item & oldid, const Tile_Item newid);
 
+    Grid_Stats stats() const;
+
+    void reset_op_stats();
+
+    Urho3D::String stats_string() const;
+
+    // Show stats_string on the HUD's app stats while the HUD is visible - op counters stay off until set_op_profiling
+    void push_hud_stats(Urho3D::DebugHud * hud);
+
+    // Time and count every grid op - off by default since it mutates the stats from const queries, so queries are
+    // only safe to run from several threads while it is off
+    void set_op_profiling(bool enable);
+
+    bool op_profiling() const;
+
+    Urho3D::JSONValue stats_json() const;
+
+    static const char * op_name(Grid_Op op);
+
     void DrawDebugGeometry(bool depth);
 
+    void set_debug_draw_mode(Debug_Draw_Mode mode);
+
+    Debug_Draw_Mode debug_draw_mode() const;
+
+    Urho3D::BoundingBox chunk_world_bounds(const Grid_Chunk * chunk) const;
+
+    // Occupiers call this when something their debug crosses depend on changes - the cross line list is rebuilt on
+    // the next draw
+    void invalidate_occupier_debug();
+
   protected:
     void OnSceneSet(Urho3D::Scene * scene) override;
 
   private:
+    struct Op_Scope;
+
     bool _check_bounds(const Map_Index & index_) const;
 
+    Grid_Chunk * _chunk(const Map_Index & index_) const;
+
+    Grid_Chunk * _acquire_chunk(const Map_Index & index_);
+
     void _resize_for_space(const Map_Index & index_);
 
     const Tile_Space & _get_id(const Map_Index & index_);
@@ -196,9 +463,53 @@ class Hex_Tile_Grid : public Urho3D::Component
 
     void _remove_component(Tile_Occupier * occ);
 
+    void _recount_allocation();
+
+    void _build_debug_lines(const Grid_Chunk * chunk, Chunk_Debug_Cache & cache);
+
+    void _build_occupier_debug_lines();
+
+    static bool _has_active(const Tile_Space & space);
+
+    static Tile_Space _active_items(const Tile_Space & space);
+
     Tile_Space dummy_ret_;
 
-    Urho3D::HashSet<Tile_Occupier *> scene_occ_comps_;
+    mutable Grid_Stats stats_;
+
+    mutable int op_depth_;
+
+    bool op_profiling_;
+
+    // Occupiers in the scene with the origin and node id their spaces are currently registered under
+    Urho3D::HashMap<Tile_Occupier *, Occupier_Entry> scene_occ_comps_;
+
+    Urho3D::HashSet<Tile_Occupier *> dirty_occs_;
+
+    bool deferred_;
+
+    bool moves_suppressed_;
+
+    int batch_depth_;
+
+    // Occupiers moved during the current batch - may hold duplicates, they are merged in to dirty_occs_ at the end
+    Urho3D::PODVector<Tile_Occupier *> batch_moved_;
+
+    // Occupiers added to the scene during the current batch, registered at the end
+    Urho3D::PODVector<Tile_Occupier *> batch_added_;
 
     Map_World world_map_;
+
+    Urho3D::PODVector<Grid_Chunk *> chunks_;
+
+    Debug_Draw_Mode debug_mode_;
+
+    Urho3D::HashMap<const Grid_Chunk *, Chunk_Debug_Cache> debug_cache_;
+
+    // Crosses for every debug enabled occupier as one line list - only rebuilt when an occupier changes
+    Urho3D::PODVector<fvec3> occ_debug_lines_;
+
+    bool occ_debug_dirty_;
+
+    uint32_t revision_;
 };
\ No newline at end of file
@@ -43,3 +43,17 @@ fmat4 ortho_from(float left_, float right_, float top_, float bottom_, float nea
     ret.m03_ = -x; ret.m13_ = -y; ret.m23_ = -z; ret.m33_ = 1.0f;
     return ret;
 }
+
+bool point_in_polygon(const fvec2 & pnt_, const Urho3D::PODVector<fvec2> & poly_)
+{
+    bool inside = false;
+    for (uint32_t i = 0, j = poly_.Size() - 1; i < poly_.Size(); j = i++)
+    {
+        const fvec2 & a = poly_[i];
+        const fvec2 & b = poly_[j];
+        if ((a.y_ > pnt_.y_) != (b.y_ > pnt_.y_) &&
+            pnt_.x_ < (b.x_ - a.x_) * (pnt_.y_ - a.y_) / (b.y_ - a.y_) + a.x_)
+            inside = !inside;
+    }
+    return inside;
+}
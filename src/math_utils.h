@@ -79,4 +79,7 @@ fmat4 perspective_from(float near_left,
                        float z_near,
                        float z_far);
 
-fmat4 ortho_from(float left_, float right_, float top_, float bottom_, float near_, float far_);
\ No newline at end of file
+fmat4 ortho_from(float left_, float right_, float top_, float bottom_, float near_, float far_);
+
+// Even-odd test - poly_ is a closed loop, the last point connects back to the first
+bool point_in_polygon(const fvec2 & pnt_, const Urho3D::PODVector<fvec2> & poly_);
\ No newline at end of file
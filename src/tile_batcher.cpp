@@ -0,0 +1,394 @@
+#include <tile_batcher.h>
+#include <chunk_mesh_baker.h>
+#include <buried_tile_culler.h>
+#include <hex_tile_grid.h>
+#include <tile_occupier.h>
+#include <mtdebug_print.h>
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Graphics/StaticModelGroup.h>
+#include <Urho3D/Scene/Scene.h>
+
+using namespace Urho3D;
+
+Tile_Batcher::Tile_Batcher(Urho3D::Context * context) : Component(context), grid_revision_(0), rebuild_all_(true)
+{
+    SubscribeToEvent(E_POSTUPDATE, URHO3D_HANDLER(Tile_Batcher, handle_post_update));
+}
+
+Tile_Batcher::~Tile_Batcher()
+{}
+
+void Tile_Batcher::set_excluded(Urho3D::Node * node, bool exclude)
+{
+    if (node == nullptr)
+        return;
+
+    if (exclude)
+    {
+        excluded_[node] = node;
+        _unbatch(node);
+        return;
+    }
+
+    if (excluded_.Erase(node))
+    {
+        // Back in to the chunk holding its origin on the next update
+        ivec3 owner = Hex_Tile_Grid::chunk_key(Hex_Tile_Grid::world_to_grid(node->GetWorldPosition()));
+        pending_[owner].Push(WeakPtr<Node>(node));
+        forced_.Insert(owner);
+    }
+}
+
+bool Tile_Batcher::is_batched(Urho3D::Node * node) const
+{
+    return batched_.Contains(node);
+}
+
+void Tile_Batcher::refresh_node(Urho3D::Node * node)
+{
+    if (node == nullptr)
+        return;
+
+    _unbatch(node);
+    ivec3 owner = Hex_Tile_Grid::chunk_key(Hex_Tile_Grid::world_to_grid(node->GetWorldPosition()));
+    pending_[owner].Push(WeakPtr<Node>(node));
+    forced_.Insert(owner);
+}
+
+void Tile_Batcher::rebuild_all()
+{
+    // Released now so nothing the groups hid stays hidden if another component takes those nodes over first
+    _release_all();
+    rebuild_all_ = true;
+}
+
+void Tile_Batcher::update()
+{
+    Scene * scn = GetScene();
+    Hex_Tile_Grid * tg = (scn != nullptr) ? scn->GetComponent<Hex_Tile_Grid>() : nullptr;
+    if (tg == nullptr || !IsEnabledEffective())
+        return;
+
+    // Nodes deleted while excluded (or whose address went to a new node) are never excluded again with false
+    auto excl_iter = excluded_.Begin();
+    while (excl_iter != excluded_.End())
+    {
+        if (excl_iter->second_ != excl_iter->first_)
+            excl_iter = excluded_.Erase(excl_iter);
+        else
+            ++excl_iter;
+    }
+
+    // Moves queued in the grid this frame have to land before the revisions are read
+    tg->flush_updates();
+
+    bool full = rebuild_all_;
+    if (rebuild_all_)
+    {
+        _release_all();
+        rebuild_all_ = false;
+    }
+
+    if (!full && forced_.Empty() && tg->revision() == grid_revision_)
+        return;
+    grid_revision_ = tg->revision();
+
+    chunk_revs_.Clear();
+    tg->chunk_revisions(chunk_revs_);
+
+    // Chunks the grid has released since the last update
+    auto chunk_iter = chunks_.Begin();
+    while (chunk_iter != chunks_.End())
+    {
+        if (chunk_revs_.Contains(chunk_iter->first_))
+        {
+            ++chunk_iter;
+            continue;
+        }
+
+        _release_chunk(chunk_iter->first_, chunk_iter->second_);
+        auto group_iter = chunk_iter->second_.groups_.Begin();
+        while (group_iter != chunk_iter->second_.groups_.End())
+        {
+            group_iter->second_->Remove();
+            ++group_iter;
+        }
+        chunk_iter = chunks_.Erase(chunk_iter);
+    }
+
+    auto rev_iter = chunk_revs_.Begin();
+    while (rev_iter != chunk_revs_.End())
+    {
+        auto fiter = chunks_.Find(rev_iter->first_);
+        if (full || fiter == chunks_.End() || fiter->second_.revision_ != rev_iter->second_ ||
+            forced_.Contains(rev_iter->first_))
+        {
+            forced_.Erase(rev_iter->first_);
+            _rebuild_chunk(rev_iter->first_, rev_iter->second_);
+        }
+        ++rev_iter;
+    }
+
+    // Rebuilds hand nodes whose origin is in another chunk over to that chunk - each node is handed over at most once
+    while (!forced_.Empty())
+    {
+        HashSet<ivec3> forced(forced_);
+        forced_.Clear();
+        auto forced_iter = forced.Begin();
+        while (forced_iter != forced.End())
+        {
+            auto fiter = chunk_revs_.Find(*forced_iter);
+            if (fiter != chunk_revs_.End())
+                _rebuild_chunk(fiter->first_, fiter->second_);
+            else
+                pending_.Erase(*forced_iter);
+            ++forced_iter;
+        }
+    }
+}
+
+uint32_t Tile_Batcher::group_count() const
+{
+    uint32_t count = 0;
+    auto iter = chunks_.Begin();
+    while (iter != chunks_.End())
+    {
+        count += iter->second_.groups_.Size();
+        ++iter;
+    }
+    return count;
+}
+
+uint32_t Tile_Batcher::batched_count() const
+{
+    return batched_.Size();
+}
+
+void Tile_Batcher::register_context(Urho3D::Context * context)
+{
+    context->RegisterFactory<Tile_Batcher>();
+}
+
+void Tile_Batcher::handle_post_update(Urho3D::StringHash event_type, Urho3D::VariantMap & event_data)
+{
+    update();
+}
+
+void Tile_Batcher::OnSceneSet(Urho3D::Scene * scene)
+{
+    if (scene == nullptr)
+        _release_all();
+    else
+        rebuild_all_ = true;
+    Component::OnSceneSet(scene);
+}
+
+void Tile_Batcher::OnSetEnabled()
+{
+    if (IsEnabledEffective())
+        rebuild_all_ = true;
+    else
+        _release_all();
+}
+
+void Tile_Batcher::_rebuild_chunk(const ivec3 & key, uint32_t revision)
+{
+    Scene * scn = GetScene();
+    Hex_Tile_Grid * tg = scn->GetComponent<Hex_Tile_Grid>();
+    Chunk_Batch & batch = chunks_[key];
+    batch.revision_ = revision;
+
+    // Whatever is in the chunk now, whatever was grouped here before (it may have moved out) and anything handed over
+    HashSet<Node *> candidates;
+    HashSet<int> ids;
+    tg->chunk_node_ids(key, ids);
+    auto id_iter = ids.Begin();
+    while (id_iter != ids.End())
+    {
+        Node * nd = scn->GetNode(*id_iter);
+        if (nd != nullptr)
+            candidates.Insert(nd);
+        ++id_iter;
+    }
+
+    auto mem_iter = batch.members_.Begin();
+    while (mem_iter != batch.members_.End())
+    {
+        if (mem_iter->second_ != nullptr)
+            candidates.Insert(mem_iter->second_);
+        ++mem_iter;
+    }
+
+    auto pend_iter = pending_.Find(key);
+    if (pend_iter != pending_.End())
+    {
+        for (uint32_t i = 0; i < pend_iter->second_.Size(); ++i)
+        {
+            if (pend_iter->second_[i] != nullptr)
+                candidates.Insert(pend_iter->second_[i]);
+        }
+        pending_.Erase(pend_iter);
+    }
+
+    _release_chunk(key, batch);
+
+    // Terrain tiles are merged in to the chunk meshes instead while the baker is enabled
+    Chunk_Mesh_Baker * baker = scn->GetComponent<Chunk_Mesh_Baker>();
+    bool baking = (baker != nullptr && baker->IsEnabledEffective());
+
+    auto cand_iter = candidates.Begin();
+    while (cand_iter != candidates.End())
+    {
+        Node * nd = *cand_iter;
+        ++cand_iter;
+
+        if (batched_.Contains(nd) || _excluded(nd) || !nd->HasComponent<Tile_Occupier>())
+            continue;
+
+        if ((baking && Chunk_Mesh_Baker::is_terrain_node(nd)) || Buried_Tile_Culler::hides(nd))
+            continue;
+
+        // A model that is already disabled was hidden on purpose and stays hidden - the groups would draw it
+        StaticModel * sm = nd->GetComponent<StaticModel>();
+        if (sm == nullptr || sm->GetModel() == nullptr || !sm->IsEnabled())
+            continue;
+
+        // A group has one material per geometry for all of its instances
+        Material * mat = sm->GetMaterial(0);
+        bool single_mat = (mat != nullptr);
+        for (uint32_t i = 1; i < sm->GetNumGeometries() && single_mat; ++i)
+            single_mat = (sm->GetMaterial(i) == mat);
+        if (!single_mat)
+            continue;
+
+        ivec3 owner = Hex_Tile_Grid::chunk_key(Hex_Tile_Grid::world_to_grid(nd->GetWorldPosition()));
+        if (owner != key)
+        {
+            // Nodes whose origin cell is in a chunk the grid never allocated are left on their own StaticModel
+            if (chunk_revs_.Contains(owner))
+            {
+                pending_[owner].Push(WeakPtr<Node>(nd));
+                forced_.Insert(owner);
+            }
+            continue;
+        }
+
+        SharedPtr<Node> & group_node = batch.groups_[Batch_Key(sm->GetModel(), mat)];
+        if (group_node == nullptr)
+        {
+            // Instances are drawn at their own world transforms so the group node just sits at the origin
+            group_node = GetNode()->CreateChild(TILE_BATCH_NODE_NAME, LOCAL);
+            group_node->SetTemporary(true);
+            StaticModelGroup * group = group_node->CreateComponent<StaticModelGroup>(LOCAL);
+            group->SetModel(sm->GetModel());
+            group->SetMaterial(mat);
+            group->SetCastShadows(sm->GetCastShadows());
+        }
+        group_node->GetComponent<StaticModelGroup>()->AddInstanceNode(nd);
+        sm->SetEnabled(false);
+        batch.members_[nd] = nd;
+        batched_[nd] = key;
+    }
+
+    auto group_iter = batch.groups_.Begin();
+    while (group_iter != batch.groups_.End())
+    {
+        if (group_iter->second_->GetComponent<StaticModelGroup>()->GetNumInstanceNodes() == 0)
+        {
+            group_iter->second_->Remove();
+            group_iter = batch.groups_.Erase(group_iter);
+        }
+        else
+        {
+            ++group_iter;
+        }
+    }
+}
+
+void Tile_Batcher::_release_chunk(const ivec3 & key, Chunk_Batch & batch)
+{
+    auto mem_iter = batch.members_.Begin();
+    while (mem_iter != batch.members_.End())
+    {
+        Node * nd = mem_iter->second_;
+        if (nd != nullptr)
+        {
+            StaticModel * sm = nd->GetComponent<StaticModel>();
+            if (sm != nullptr)
+                sm->SetEnabled(true);
+            batched_.Erase(nd);
+        }
+        else
+        {
+            // Deleted node - only drop the entry if a new node at the same address has not been batched elsewhere
+            auto fiter = batched_.Find(mem_iter->first_);
+            if (fiter != batched_.End() && fiter->second_ == key)
+                batched_.Erase(fiter);
+        }
+        ++mem_iter;
+    }
+    batch.members_.Clear();
+
+    auto group_iter = batch.groups_.Begin();
+    while (group_iter != batch.groups_.End())
+    {
+        group_iter->second_->GetComponent<StaticModelGroup>()->RemoveAllInstanceNodes();
+        ++group_iter;
+    }
+}
+
+void Tile_Batcher::_release_all()
+{
+    auto chunk_iter = chunks_.Begin();
+    while (chunk_iter != chunks_.End())
+    {
+        _release_chunk(chunk_iter->first_, chunk_iter->second_);
+        auto group_iter = chunk_iter->second_.groups_.Begin();
+        while (group_iter != chunk_iter->second_.groups_.End())
+        {
+            group_iter->second_->Remove();
+            ++group_iter;
+        }
+        ++chunk_iter;
+    }
+    chunks_.Clear();
+    batched_.Clear();
+    pending_.Clear();
+    forced_.Clear();
+    grid_revision_ = 0;
+}
+
+void Tile_Batcher::_unbatch(Urho3D::Node * node)
+{
+    auto fiter = batched_.Find(node);
+    if (fiter == batched_.End())
+        return;
+
+    auto chunk_iter = chunks_.Find(fiter->second_);
+    batched_.Erase(fiter);
+    if (chunk_iter == chunks_.End())
+        return;
+
+    Chunk_Batch & batch = chunk_iter->second_;
+    batch.members_.Erase(node);
+    auto group_iter = batch.groups_.Begin();
+    while (group_iter != batch.groups_.End())
+    {
+        group_iter->second_->GetComponent<StaticModelGroup>()->RemoveInstanceNode(node);
+        ++group_iter;
+    }
+
+    StaticModel * sm = node->GetComponent<StaticModel>();
+    if (sm != nullptr)
+        sm->SetEnabled(true);
+}
+
+bool Tile_Batcher::_excluded(Urho3D::Node * node) const
+{
+    auto fiter = excluded_.Find(node);
+    return fiter != excluded_.End() && fiter->second_ == node;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <Urho3D/Scene/Component.h>
+#include <Urho3D/Container/HashSet.h>
+#include <math_utils.h>
+
+const Urho3D::String TILE_BATCH_NODE_NAME = "Tile_Batch";
+
+namespace Urho3D
+{
+class Scene;
+class Node;
+class Model;
+class Material;
+class StaticModelGroup;
+} // namespace Urho3D
+
+/*!
+Renders grid tiles as one StaticModelGroup per grid chunk, model and material instead of one StaticModel per tile, so
+draw calls scale with the number of chunks rather than tiles. Any node with a Tile_Occupier and a StaticModel using a
+single material for all of its geometries is batched with the chunk holding its origin cell - its own StaticModel is
+disabled while it is in a group. Tiles whose StaticModel is already disabled are left alone, and only the models the
+batcher disabled are enabled again.
+
+The grid drives the rebuilds: each update the chunk revisions are compared with the ones the groups were built at and
+only the chunks that changed are re-grouped. Nodes whose materials are about to be swapped (like the selection
+outline) should be excluded first so they render on their own. A material change on a batched node is not noticed
+until its chunk changes - call rebuild_all after doing that. Terrain tiles are left to the Chunk_Mesh_Baker while
+one is enabled and tiles hidden by the Buried_Tile_Culler are left out.
+
+Disabling the component puts every tile back on its own StaticModel. The disabled models are saved as they are, so
+save nodes holding tiles inside a Tile_Save_Scope.
+*/
+class Tile_Batcher : public Urho3D::Component
+{
+    URHO3D_OBJECT(Tile_Batcher, Urho3D::Component);
+
+  public:
+    Tile_Batcher(Urho3D::Context * context);
+    ~Tile_Batcher();
+
+    // Render node with its own StaticModel instead of a group until it is excluded again with false
+    void set_excluded(Urho3D::Node * node, bool exclude);
+
+    bool is_batched(Urho3D::Node * node) const;
+
+    // Take node out of its group now and reconsider it on the next update - for when something else starts or stops
+    // hiding it
+    void refresh_node(Urho3D::Node * node);
+
+    // Drop every group now and re-group every chunk on the next update
+    void rebuild_all();
+
+    // Re-group the chunks that changed since the last update
+    void update();
+
+    uint32_t group_count() const;
+
+    uint32_t batched_count() const;
+
+    static void register_context(Urho3D::Context * context);
+
+    void handle_post_update(Urho3D::StringHash event_type, Urho3D::VariantMap & event_data);
+
+  protected:
+    void OnSceneSet(Urho3D::Scene * scene) override;
+
+    void OnSetEnabled() override;
+
+  private:
+    using Batch_Key = Urho3D::Pair<Urho3D::Model *, Urho3D::Material *>;
+
+    struct Chunk_Batch
+    {
+        Chunk_Batch() : revision_(0)
+        {}
+
+        uint32_t revision_;
+
+        Urho3D::HashMap<Batch_Key, Urho3D::SharedPtr<Urho3D::Node>> groups_;
+
+        Urho3D::HashMap<Urho3D::Node *, Urho3D::WeakPtr<Urho3D::Node>> members_;
+    };
+
+    void _rebuild_chunk(const ivec3 & key, uint32_t revision);
+
+    // Take every node out of the chunk's groups and show its own StaticModel again
+    void _release_chunk(const ivec3 & key, Chunk_Batch & batch);
+
+    void _release_all();
+
+    void _unbatch(Urho3D::Node * node);
+
+    bool _excluded(Urho3D::Node * node) const;
+
+    Urho3D::HashMap<ivec3, Chunk_Batch> chunks_;
+
+    // Chunk each batched node is grouped in
+    Urho3D::HashMap<Urho3D::Node *, ivec3> batched_;
+
+    Urho3D::HashMap<Urho3D::Node *, Urho3D::WeakPtr<Urho3D::Node>> excluded_;
+
+    // Nodes found in one chunk whose origin is in another, to be picked up by that chunk's rebuild
+    Urho3D::HashMap<ivec3, Urho3D::Vector<Urho3D::WeakPtr<Urho3D::Node>>> pending_;
+
+    // Chunks to rebuild on the next update even if their revision has not changed
+    Urho3D::HashSet<ivec3> forced_;
+
+    // Grid chunk revisions as of the current update
+    Urho3D::HashMap<ivec3, uint32_t> chunk_revs_;
+
+    uint32_t grid_revision_;
+
+    bool rebuild_all_;
+};
@@ -0,0 +1,228 @@
+#include <tile_footprint.h>
+#include <hex_tile_grid.h>
+
+#include <Urho3D/Container/Sort.h>
+
+using namespace Urho3D;
+
+namespace
+{
+// Buckets of footprints keyed by the hash of their spaces - collisions are resolved by comparing the spaces. The table
+// does not hold references, each footprint removes itself on destruction.
+using Footprint_Bucket = PODVector<Tile_Footprint *>;
+using Footprint_Table = HashMap<uint32_t, Footprint_Bucket>;
+
+Footprint_Table & footprint_table()
+{
+    static Footprint_Table table;
+    return table;
+}
+
+bool space_less(const ivec3 & lhs, const ivec3 & rhs)
+{
+    if (lhs.z_ != rhs.z_)
+        return lhs.z_ < rhs.z_;
+    if (lhs.y_ != rhs.y_)
+        return lhs.y_ < rhs.y_;
+    return lhs.x_ < rhs.x_;
+}
+
+bool same_spaces(const Vector<ivec3> & lhs, const VariantVector & rhs)
+{
+    if (lhs.Size() != rhs.Size())
+        return false;
+    for (uint32_t i = 0; i < lhs.Size(); ++i)
+    {
+        if (lhs[i] != rhs[i].GetIntVector3())
+            return false;
+    }
+    return true;
+}
+
+bool sorted_spaces(const VariantVector & spaces)
+{
+    for (uint32_t i = 1; i < spaces.Size(); ++i)
+    {
+        if (!space_less(spaces[i - 1].GetIntVector3(), spaces[i].GetIntVector3()))
+            return false;
+    }
+    return true;
+}
+} // namespace
+
+Tile_Footprint::Tile_Footprint(const Urho3D::Vector<ivec3> & spaces, uint32_t hash) : spaces_(spaces), hash_(hash)
+{
+    variant_spaces_.Resize(spaces_.Size());
+    for (uint32_t i = 0; i < spaces_.Size(); ++i)
+        variant_spaces_[i] = spaces_[i];
+}
+
+Tile_Footprint::~Tile_Footprint()
+{
+    Footprint_Table & table = footprint_table();
+    auto iter = table.Find(hash_);
+    if (iter == table.End())
+        return;
+
+    iter->second_.RemoveSwap(this);
+    if (iter->second_.Empty())
+        table.Erase(iter);
+}
+
+Urho3D::SharedPtr<Tile_Footprint> Tile_Footprint::intern(const Urho3D::Vector<ivec3> & spaces)
+{
+    Vector<ivec3> sorted(spaces);
+    Sort(sorted.Begin(), sorted.End(), space_less);
+    return _intern_sorted(sorted);
+}
+
+/*!
+Look the footprint up straight from the saved attribute - saved spaces are already sorted so they are only converted
+out of the variants when the footprint has not been seen before, and loading a scene costs one conversion per unique
+footprint.
+*/
+Urho3D::SharedPtr<Tile_Footprint> Tile_Footprint::intern(const Urho3D::VariantVector & spaces)
+{
+    if (spaces.Empty())
+        return single_cell();
+
+    if (sorted_spaces(spaces))
+    {
+        uint32_t hash = _hash(spaces);
+        auto iter = footprint_table().Find(hash);
+        if (iter != footprint_table().End())
+        {
+            const Footprint_Bucket & bucket = iter->second_;
+            for (uint32_t i = 0; i < bucket.Size(); ++i)
+            {
+                if (same_spaces(bucket[i]->spaces_, spaces))
+                    return SharedPtr<Tile_Footprint>(bucket[i]);
+            }
+        }
+    }
+
+    Vector<ivec3> converted(spaces.Size());
+    for (uint32_t i = 0; i < spaces.Size(); ++i)
+        converted[i] = spaces[i].GetIntVector3();
+    return intern(converted);
+}
+
+Urho3D::SharedPtr<Tile_Footprint> Tile_Footprint::_intern_sorted(const Urho3D::Vector<ivec3> & spaces)
+{
+    uint32_t hash = _hash(spaces);
+    Footprint_Bucket & bucket = footprint_table()[hash];
+    for (uint32_t i = 0; i < bucket.Size(); ++i)
+    {
+        if (bucket[i]->spaces_ == spaces)
+            return SharedPtr<Tile_Footprint>(bucket[i]);
+    }
+
+    SharedPtr<Tile_Footprint> fp(new Tile_Footprint(spaces, hash));
+    bucket.Push(fp.Get());
+    return fp;
+}
+
+Urho3D::SharedPtr<Tile_Footprint> Tile_Footprint::single_cell()
+{
+    Vector<ivec3> spaces;
+    spaces.Push(ivec3());
+    return intern(spaces);
+}
+
+uint32_t Tile_Footprint::unique_count()
+{
+    uint32_t count = 0;
+    Footprint_Table & table = footprint_table();
+    auto iter = table.Begin();
+    while (iter != table.End())
+    {
+        count += iter->second_.Size();
+        ++iter;
+    }
+    return count;
+}
+
+int Tile_Footprint::rotation_step(const fquat & rotation)
+{
+    fvec3 dir = rotation * fvec3::RIGHT;
+    float angle = Urho3D::Atan2(dir.y_, dir.x_);
+    int step = int(std::round(angle * FOOTPRINT_ROTATION_STEPS / 360.0f));
+    return ((step % FOOTPRINT_ROTATION_STEPS) + FOOTPRINT_ROTATION_STEPS) % FOOTPRINT_ROTATION_STEPS;
+}
+
+const Urho3D::Vector<ivec3> & Tile_Footprint::spaces() const
+{
+    return spaces_;
+}
+
+const Urho3D::VariantVector & Tile_Footprint::variant_spaces() const
+{
+    return variant_spaces_;
+}
+
+uint32_t Tile_Footprint::hash() const
+{
+    return hash_;
+}
+
+Urho3D::SharedPtr<Tile_Footprint> Tile_Footprint::with_space(const ivec3 & space) const
+{
+    Vector<ivec3> spaces(spaces_);
+    if (!spaces.Contains(space))
+        spaces.Push(space);
+    return intern(spaces);
+}
+
+Urho3D::SharedPtr<Tile_Footprint> Tile_Footprint::without_space(const ivec3 & space) const
+{
+    Vector<ivec3> spaces(spaces_);
+    spaces.Remove(space);
+    if (spaces.Empty())
+        spaces.Push(ivec3());
+    return intern(spaces);
+}
+
+Urho3D::SharedPtr<Tile_Footprint> Tile_Footprint::rotated(int steps)
+{
+    steps = ((steps % FOOTPRINT_ROTATION_STEPS) + FOOTPRINT_ROTATION_STEPS) % FOOTPRINT_ROTATION_STEPS;
+    if (steps == 0)
+        return SharedPtr<Tile_Footprint>(this);
+
+    SharedPtr<Tile_Footprint> fp = rotations_[steps].Lock();
+    if (fp != nullptr)
+        return fp;
+
+    Vector<ivec3> spaces(spaces_.Size());
+    for (uint32_t i = 0; i < spaces_.Size(); ++i)
+        spaces[i] = Hex_Tile_Grid::rotate_cell(spaces_[i], steps);
+
+    // Link both ways so rotating back is also a lookup
+    fp = intern(spaces);
+    rotations_[steps] = fp;
+    fp->rotations_[FOOTPRINT_ROTATION_STEPS - steps] = this;
+    return fp;
+}
+
+uint32_t Tile_Footprint::_hash(const Urho3D::Vector<ivec3> & spaces)
+{
+    uint32_t hash = spaces.Size();
+    for (uint32_t i = 0; i < spaces.Size(); ++i)
+        hash = _hash_combine(hash, spaces[i]);
+    return hash;
+}
+
+uint32_t Tile_Footprint::_hash(const Urho3D::VariantVector & spaces)
+{
+    uint32_t hash = spaces.Size();
+    for (uint32_t i = 0; i < spaces.Size(); ++i)
+        hash = _hash_combine(hash, spaces[i].GetIntVector3());
+    return hash;
+}
+
+uint32_t Tile_Footprint::_hash_combine(uint32_t hash, const ivec3 & space)
+{
+    hash ^= uint32_t(space.x_) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    hash ^= uint32_t(space.y_) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    hash ^= uint32_t(space.z_) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    return hash;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+const int FOOTPRINT_ROTATION_STEPS = 6;
+
+#include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Core/Variant.h>
+#include <math_utils.h>
+
+/*!
+Immutable list of grid spaces an occupier covers relative to its origin. Footprints are hash-consed - every distinct
+set of spaces exists once in the intern table and occupiers only hold a SharedPtr to it, so thousands of single cell
+tiles share one footprint. Spaces are sorted when interned so the same set given in any order is the same footprint.
+Never modify a footprint in place; build the new list and intern it instead.
+
+The table does not own its footprints - a footprint takes itself out of the table when the last reference to it goes.
+
+Each footprint also remembers its six 60 degree rotations once they have been asked for, so rotating an occupier is a
+handle swap. The links are weak so rotations do not keep each other alive.
+
+The intern table is not thread safe and should only be touched from the main thread.
+*/
+class Tile_Footprint : public Urho3D::RefCounted
+{
+  public:
+    static Urho3D::SharedPtr<Tile_Footprint> intern(const Urho3D::Vector<ivec3> & spaces);
+
+    static Urho3D::SharedPtr<Tile_Footprint> intern(const Urho3D::VariantVector & spaces);
+
+    // The footprint covering only the origin cell
+    static Urho3D::SharedPtr<Tile_Footprint> single_cell();
+
+    static uint32_t unique_count();
+
+    // Nearest 60 degree step of the rotation about the z axis, in [0, FOOTPRINT_ROTATION_STEPS)
+    static int rotation_step(const fquat & rotation);
+
+    const Urho3D::Vector<ivec3> & spaces() const;
+
+    // Spaces converted to variants once on creation, used for the occupier's save attribute
+    const Urho3D::VariantVector & variant_spaces() const;
+
+    uint32_t hash() const;
+
+    // Return the interned footprint with the space added or removed - this footprint is left untouched
+    Urho3D::SharedPtr<Tile_Footprint> with_space(const ivec3 & space) const;
+
+    Urho3D::SharedPtr<Tile_Footprint> without_space(const ivec3 & space) const;
+
+    // This footprint rotated steps * 60 degrees counter clockwise about the origin cell
+    Urho3D::SharedPtr<Tile_Footprint> rotated(int steps);
+
+    ~Tile_Footprint();
+
+  private:
+    Tile_Footprint(const Urho3D::Vector<ivec3> & spaces, uint32_t hash);
+
+    // Intern spaces that are already sorted
+    static Urho3D::SharedPtr<Tile_Footprint> _intern_sorted(const Urho3D::Vector<ivec3> & spaces);
+
+    static uint32_t _hash(const Urho3D::Vector<ivec3> & spaces);
+
+    static uint32_t _hash(const Urho3D::VariantVector & spaces);
+
+    static uint32_t _hash_combine(uint32_t hash, const ivec3 & space);
+
+    Urho3D::Vector<ivec3> spaces_;
+
+    Urho3D::VariantVector variant_spaces_;
+
+    uint32_t hash_;
+
+    Urho3D::WeakPtr<Tile_Footprint> rotations_[FOOTPRINT_ROTATION_STEPS];
+};
@@ -1,53 +1,302 @@
 #include <Urho3D/Core/Context.h>
-#include <Urho3D/Graphics/DebugRenderer.h>
+#include <Urho3D/Graphics/StaticModel.h>
 #include <Urho3D/Scene/Scene.h>
 #include <Urho3D/Scene/SceneEvents.h>
 #include <hex_tile_grid.h>
 #include <mtdebug_print.h>
 #include <tile_occupier.h>
+#include <tile_voxelizer.h>
 
 using namespace Urho3D;
 
-Tile_Occupier::Tile_Occupier(Urho3D::Context * context) : Component(context), draw_debug_(false), scoobers("Poopy")
-{
-    spaces_.Push(ivec3());
-}
+Tile_Occupier::Tile_Occupier(Urho3D::Context * context) : Component(context), draw_debug_(false),
+      footprint_from_model_(false),
+      rotation_step_(0),
+      compound_(false),
+      scoobers("Poopy"),
+      footprint_(Tile_Footprint::single_cell())
+{}
 
 Tile_Occupier::~Tile_Occupier()
 {}
 
 void Tile_Occupier::build_from_model(Urho3D::Model * model)
-{}
+{
+    if (model == nullptr || node_ == nullptr)
+        return;
 
-void Tile_Occupier::add(const ivec3 & grid)
+    Tile_Voxelizer * vox = GetSubsystem<Tile_Voxelizer>();
+    if (vox == nullptr)
+    {
+        eout << "No Tile_Voxelizer subsystem registered - cannot build footprint from" << model->GetName();
+        return;
+    }
+    // The step is only applied once the footprint arrives - until then the old footprint is still at the old step
+    vox->request(this, model, Tile_Footprint::rotation_step(node_->GetWorldRotation()));
+}
+
+void Tile_Occupier::set_base_footprint(Tile_Footprint * base, int step)
 {
-    if (!spaces_.Contains(grid))
+    if (base == nullptr)
+        return;
+
+    // Swapping the footprint only needs the old spaces, so the step can change first
+    rotation_step_ = step;
+    set_footprint(base->rotated(step));
+
+    // The node may have turned again while the footprint was being built - let the grid catch the spaces up
+    if (node_ != nullptr && Tile_Footprint::rotation_step(node_->GetWorldRotation()) != step)
+        OnMarkedDirty(node_);
+}
+
+int Tile_Occupier::rotation_step() const
+{
+    return rotation_step_;
+}
+
+void Tile_Occupier::_apply_rotation_step(int step)
+{
+    // The compound's children turn with the root's node so rotating the union about the root is still correct
+    int delta = step - rotation_step_;
+    footprint_ = footprint_->rotated(delta);
+    if (own_footprint_ != nullptr)
+        own_footprint_ = own_footprint_->rotated(delta);
+    rotation_step_ = step;
+
+    // Absorbed children are out of the grid and hear nothing of the turn - keep their spaces at the same step as their
+    // node so the next union rebuild offsets spaces that are already rotated
+    for (uint32_t i = 0; i < compound_children_.Size(); ++i)
+    {
+        Tile_Occupier * child = compound_children_[i];
+        if (child != nullptr)
+            child->_apply_rotation_step(
+                ((child->rotation_step_ + delta) % FOOTPRINT_ROTATION_STEPS + FOOTPRINT_ROTATION_STEPS) %
+                FOOTPRINT_ROTATION_STEPS);
+    }
+}
+
+void Tile_Occupier::set_compound(bool enable)
+{
+    compound_ = enable;
+    if (compound_)
+        rebuild_compound();
+    else
+        _dissolve_compound();
+}
+
+bool Tile_Occupier::compound() const
+{
+    return compound_;
+}
+
+void Tile_Occupier::rebuild_compound()
+{
+    if (!compound_ || node_ == nullptr || compound_root_ != nullptr)
+        return;
+
+    if (own_footprint_ == nullptr)
+        own_footprint_ = footprint_;
+
+    PODVector<Tile_Occupier *> occs;
+    node_->GetComponents<Tile_Occupier>(occs, true);
+    for (uint32_t i = 0; i < occs.Size(); ++i)
     {
-        // We need to add this item now to the tile grid
-        Scene * scn = GetScene();
-        Hex_Tile_Grid * tg = scn->GetComponent<Hex_Tile_Grid>();
+        Tile_Occupier * occ = occs[i];
+        if (occ == this || occ->compound_root_ == this)
+            continue;
+
+        occ->_dissolve_compound();
+        occ->_absorb(this);
+        compound_children_.Push(WeakPtr<Tile_Occupier>(occ));
+    }
+    _update_compound_footprint();
+}
+
+Tile_Occupier * Tile_Occupier::compound_root() const
+{
+    return compound_root_;
+}
+
+Tile_Footprint * Tile_Occupier::_own_footprint() const
+{
+    return (own_footprint_ != nullptr) ? own_footprint_ : footprint_;
+}
+
+void Tile_Occupier::_update_compound_footprint()
+{
+    if (own_footprint_ == nullptr)
+        return;
+
+    // Children's spaces are offset by how many cells their node is from the root node - the difference is taken in
+    // axial coords since an offset coord difference depends on the rows the two nodes are on
+    Vector<ivec3> spaces = own_footprint_->spaces();
+    ivec3 root_axial = Hex_Tile_Grid::offset_to_axial(Hex_Tile_Grid::world_to_grid(node_->GetWorldPosition()));
+    for (uint32_t i = 0; i < compound_children_.Size(); ++i)
+    {
+        Tile_Occupier * child = compound_children_[i];
+        if (child == nullptr || child->node_ == nullptr || !child->IsEnabled())
+            continue;
+
+        ivec3 child_cell = Hex_Tile_Grid::world_to_grid(child->node_->GetWorldPosition());
+        ivec3 delta = Hex_Tile_Grid::offset_to_axial(child_cell) - root_axial;
+        const Vector<ivec3> & child_spaces = child->tile_spaces();
+        for (uint32_t s = 0; s < child_spaces.Size(); ++s)
+        {
+            ivec3 space = Hex_Tile_Grid::axial_to_offset(Hex_Tile_Grid::offset_to_axial(child_spaces[s]) + delta);
+            if (!spaces.Contains(space))
+                spaces.Push(space);
+        }
+    }
+    _swap_footprint(Tile_Footprint::intern(spaces));
+}
+
+void Tile_Occupier::_dissolve_compound()
+{
+    Scene * scn = GetScene();
+    Hex_Tile_Grid * tg = (scn != nullptr) ? scn->GetComponent<Hex_Tile_Grid>() : nullptr;
+    for (uint32_t i = 0; i < compound_children_.Size(); ++i)
+    {
+        Tile_Occupier * child = compound_children_[i];
+        if (child == nullptr)
+            continue;
+
+        child->compound_root_.Reset();
+        if (child->node_ != nullptr)
+            child->node_->AddListener(child);
         if (tg != nullptr)
-            tg->add(Hex_Tile_Grid::Tile_Item(node_->GetID()),grid, node_->GetWorldPosition());
+            tg->register_occupier(child);
+    }
+    compound_children_.Clear();
 
-        spaces_.Push(grid);
+    if (own_footprint_ != nullptr)
+    {
+        SharedPtr<Tile_Footprint> own(own_footprint_);
+        own_footprint_.Reset();
+        _swap_footprint(own);
     }
 }
 
-void Tile_Occupier::remove(const ivec3 & grid)
+void Tile_Occupier::_absorb(Tile_Occupier * root)
 {
-    // If this is already in the tile grid, remove it now
+    compound_root_ = root;
+    if (node_ != nullptr)
+        node_->RemoveListener(this);
+
     Scene * scn = GetScene();
-    Hex_Tile_Grid * tg = scn->GetComponent<Hex_Tile_Grid>();
+    Hex_Tile_Grid * tg = (scn != nullptr) ? scn->GetComponent<Hex_Tile_Grid>() : nullptr;
     if (tg != nullptr)
-        tg->remove(grid, node_->GetWorldPosition(), Hex_Tile_Grid::Tile_Item(node_->GetID()));
-    
-    spaces_.Remove(grid);
-    if (spaces_.Empty())
-        spaces_.Push(ivec3());
+        tg->unregister_occupier(this);
+}
+
+void Tile_Occupier::_child_released(Tile_Occupier * child)
+{
+    for (uint32_t i = 0; i < compound_children_.Size(); ++i)
+    {
+        if (compound_children_[i] == child)
+        {
+            compound_children_.Erase(i);
+            break;
+        }
+    }
+    _update_compound_footprint();
+}
+
+void Tile_Occupier::set_footprint_from_model(bool enable)
+{
+    footprint_from_model_ = enable;
+}
+
+bool Tile_Occupier::footprint_from_model() const
+{
+    return footprint_from_model_;
 }
+
+void Tile_Occupier::ApplyAttributes()
+{
+    if (node_ == nullptr)
+        return;
+
+    if (compound_)
+        rebuild_compound();
+    else if (own_footprint_ != nullptr)
+        _dissolve_compound();
+
+    if (!footprint_from_model_)
+        return;
+
+    StaticModel * smodel = node_->GetComponent<StaticModel>();
+    if (smodel != nullptr)
+        build_from_model(smodel->GetModel());
+}
+
+void Tile_Occupier::add(const ivec3 & grid)
+{
+    Tile_Footprint * own = _own_footprint();
+    if (!own->spaces().Contains(grid))
+        set_footprint(own->with_space(grid));
+}
+
+void Tile_Occupier::remove(const ivec3 & grid)
+{
+    Tile_Footprint * own = _own_footprint();
+    if (own->spaces().Contains(grid))
+        set_footprint(own->without_space(grid));
+}
+
 const Urho3D::Vector<ivec3> & Tile_Occupier::tile_spaces()
 {
-    return spaces_;
+    return footprint_->spaces();
+}
+
+Tile_Footprint * Tile_Occupier::footprint()
+{
+    return footprint_;
+}
+
+void Tile_Occupier::set_footprint(Tile_Footprint * footprint)
+{
+    if (footprint == nullptr)
+        return;
+
+    if (own_footprint_ != nullptr)
+    {
+        own_footprint_ = footprint;
+        _update_compound_footprint();
+    }
+    else
+    {
+        _swap_footprint(footprint);
+    }
+}
+
+void Tile_Occupier::_swap_footprint(Tile_Footprint * footprint)
+{
+    if (footprint == footprint_)
+        return;
+
+    // Absorbed occupiers are not in the grid - the root's union has to pick the change up instead
+    if (compound_root_ != nullptr)
+    {
+        footprint_ = footprint;
+        compound_root_->_update_compound_footprint();
+        return;
+    }
+
+    // Keep the old footprint alive until its spaces are out of the grid
+    SharedPtr<Tile_Footprint> old_fp(footprint_);
+    footprint_ = footprint;
+    if (draw_debug_)
+        _invalidate_grid_debug();
+
+    Scene * scn = GetScene();
+    Hex_Tile_Grid * tg = (scn != nullptr) ? scn->GetComponent<Hex_Tile_Grid>() : nullptr;
+    if (tg == nullptr || !tg->occupier_registered(this))
+        return;
+
+    Hex_Tile_Grid::Tile_Item item(node_->GetID(), IsEnabled());
+    fvec3 origin = tg->occupier_origin(this);
+    tg->remove(old_fp->spaces(), origin, item);
+    tg->add(item, footprint_->spaces(), origin);
 }
 
 void Tile_Occupier::register_context(Urho3D::Context * context)
@@ -56,13 +305,28 @@ void Tile_Occupier::register_context(Urho3D::Context * context)
     URHO3D_ACCESSOR_ATTRIBUTE(
         "Spaces", get_spaces, set_spaces, VariantVector, Variant::emptyVariantVector, AM_FILE);
     URHO3D_ACCESSOR_ATTRIBUTE("Is Enabled", IsEnabled, SetEnabled, bool, true, AM_DEFAULT);
+    URHO3D_ATTRIBUTE("Footprint From Model", bool, footprint_from_model_, false, AM_DEFAULT);
+    URHO3D_ATTRIBUTE("Rotation Step", int, rotation_step_, 0, AM_DEFAULT);
+    URHO3D_ATTRIBUTE("Compound", bool, compound_, false, AM_DEFAULT);
     URHO3D_ATTRIBUTE("Scooby", String, scoobers, String(), AM_DEFAULT);
     URHO3D_ATTRIBUTE("Coolio", int, coolio, 0, AM_DEFAULT);
 }
 
 void Tile_Occupier::enable_debug(bool enable)
 {
+    if (draw_debug_ == enable)
+        return;
+
     draw_debug_ = enable;
+    _invalidate_grid_debug();
+}
+
+void Tile_Occupier::_invalidate_grid_debug()
+{
+    Scene * scn = GetScene();
+    Hex_Tile_Grid * tg = (scn != nullptr) ? scn->GetComponent<Hex_Tile_Grid>() : nullptr;
+    if (tg != nullptr)
+        tg->invalidate_occupier_debug();
 }
 
 bool Tile_Occupier::debug_enabled()
@@ -72,75 +336,64 @@ bool Tile_Occupier::debug_enabled()
 
 void Tile_Occupier::set_spaces(const Urho3D::VariantVector & spaces)
 {
-    spaces_.Resize(spaces.Size());
-    for (int i = 0; i < spaces.Size(); ++i)
-        spaces_[i] = spaces[i].GetIntVector3();
+    set_footprint(Tile_Footprint::intern(spaces));
 }
 
-Urho3D::VariantVector Tile_Occupier::get_spaces() const
+const Urho3D::VariantVector & Tile_Occupier::get_spaces() const
 {
-    VariantVector spaces;
-    spaces.Resize(spaces_.Size());
-    for (int i = 0; i < spaces.Size(); ++i)
-        spaces[i] = spaces_[i];
-    return spaces;
+    // Only the root's own spaces are saved - the union is rebuilt from the subtree on load
+    return _own_footprint()->variant_spaces();
 }
 
 void Tile_Occupier::OnNodeSet(Urho3D::Node * node)
 {
     Component::OnNodeSet(node);
+    if (node != nullptr)
+        node->AddListener(this);
 }
 
-void Tile_Occupier::OnSetEnabled()
+void Tile_Occupier::OnSceneSet(Urho3D::Scene * scene)
 {
-    bool enabled = IsEnabled();
-    uint32_t node_id = node_->GetID();
-
-    Scene * scn = GetScene();
-    Hex_Tile_Grid * tg = scn->GetComponent<Hex_Tile_Grid>();
-    if (tg == nullptr)
-        return;
+    // Leaving the scene - give absorbed occupiers back to the grid or take ourselves out of our root's union
+    if (scene == nullptr)
+    {
+        // Removing the node (or a parent, or clearing the scene) sends no E_COMPONENTREMOVED so the grid would keep
+        // a dangling pointer to us
+        if (grid_ != nullptr)
+            grid_->unregister_occupier(this);
 
-    tg->remove(spaces_, node_->GetWorldPosition(), Hex_Tile_Grid::Tile_Item(node_id));
- 
-    if (enabled)   
-        tg->add(Hex_Tile_Grid::Tile_Item(node_id), spaces_, node_->GetWorldPosition());
+        if (compound_root_ != nullptr)
+        {
+            WeakPtr<Tile_Occupier> root(compound_root_);
+            compound_root_.Reset();
+            root->_child_released(this);
+        }
+        _dissolve_compound();
+    }
+    Component::OnSceneSet(scene);
 }
 
-void Tile_Occupier::OnMarkedDirty(Urho3D::Node * node)
+void Tile_Occupier::OnSetEnabled()
 {
-    if (!enabled_)
+    // Absorbed occupiers only count through their root's union
+    if (compound_root_ != nullptr)
+    {
+        compound_root_->_update_compound_footprint();
         return;
-    
+    }
+
     Scene * scn = GetScene();
-    Hex_Tile_Grid * tg = scn->GetComponent<Hex_Tile_Grid>();
-    if (tg == nullptr)
-        return;
-    uint32_t node_id = node->GetID();
-    tg->remove(spaces_, old_position_, Hex_Tile_Grid::Tile_Item(node_id));
-    fvec3 new_position = node->GetWorldPosition();
-    tg->add(Hex_Tile_Grid::Tile_Item(node_id), spaces_, new_position);
-    old_position_ = node->GetWorldPosition();
+    Hex_Tile_Grid * tg = (scn != nullptr) ? scn->GetComponent<Hex_Tile_Grid>() : nullptr;
+    if (tg != nullptr)
+        tg->set_occupier_active(this, IsEnabled());
 }
 
-void Tile_Occupier::DrawDebugGeometry(bool depth)
+void Tile_Occupier::OnMarkedDirty(Urho3D::Node * node)
 {
-    if (!IsEnabled())
-        return;
-
-    Scene * scn = GetScene();
-    if (scn == nullptr)
-        return;
-
-    DebugRenderer * deb = scn->GetComponent<DebugRenderer>();
-    if (deb == nullptr)
-        return;
-
-    for (int i = 0; i < spaces_.Size(); ++i)
-    {
-        deb->AddCross(Hex_Tile_Grid::grid_to_world(spaces_[i], GetNode()->GetPosition()),
-                      1.0f,
-                      Color(0.0f, 0.0f, 1.0f),
-                      depth);
-    }
+    // Disabled occupiers keep their (inactive) items in the grid so they still have to follow the node. Only
+    // registered occupiers have anything to move - looking the grid up in the scene here would cost a component
+    // search per node of every large move.
+    if (grid_ != nullptr)
+        grid_->occupier_moved(this);
 }
+
@@ -2,56 +2,130 @@
 
 #include <Urho3D/Scene/Component.h>
 #include <math_utils.h>
+#include <tile_footprint.h>
 
 namespace Urho3D
 {
 class Model;
 }
 
+class Hex_Tile_Grid;
+
 class Tile_Occupier : public Urho3D::Component
 {
     URHO3D_OBJECT(Tile_Occupier, Component);
 
+    friend class Hex_Tile_Grid;
+
   public:
     Tile_Occupier(Urho3D::Context * context);
     ~Tile_Occupier();
 
+    // Voxelize model at the node's current rotation - the footprint is swapped in once the voxelizer is done
     void build_from_model(Urho3D::Model * model);
 
+    // When set the footprint is rebuilt from the node's StaticModel whenever attributes are applied (ie on load)
+    void set_footprint_from_model(bool enable);
+
+    bool footprint_from_model() const;
+
     void add(const ivec3 & grid);
 
     void remove(const ivec3 & grid);
 
     const Urho3D::Vector<ivec3> & tile_spaces();
 
+    Tile_Footprint * footprint();
+
+    // Swap the shared footprint - the grid cells are updated if the occupier is registered. For a compound root this
+    // sets the root's own spaces and the union is rebuilt around them.
+    void set_footprint(Tile_Footprint * footprint);
+
+    // Set the footprint from its unrotated form along with the 60 degree step it is rotated by - the two always change
+    // together so the grid never rotates spaces that were already rotated
+    void set_base_footprint(Tile_Footprint * base, int step);
+
+    // The 60 degree step the footprint is currently rotated by - follows the node's world rotation about z
+    int rotation_step() const;
+
+    /*!
+    A compound occupier owns the union of its own spaces and those of every occupier in its subtree. The subtree's
+    occupiers stop listening to their nodes and are taken out of the grid, so moving the root updates the grid once for
+    the whole prefab. Moving a child relative to the root is not tracked - call rebuild_compound after editing the
+    prefab. Nested compounds are flattened in to the outermost one.
+    */
+    void set_compound(bool enable);
+
+    bool compound() const;
+
+    // Re-gather the subtree's occupiers and rebuild the union footprint
+    void rebuild_compound();
+
+    // The compound root that absorbed this occupier, or nullptr
+    Tile_Occupier * compound_root() const;
+
     static void register_context(Urho3D::Context * ctxt);
 
+    // Crosses on the occupier's cells are drawn by the grid's DrawDebugGeometry, batched with every other occupier's
     void enable_debug(bool enable);
 
     bool debug_enabled();
 
-    void DrawDebugGeometry(bool depth);
-
     void OnSetEnabled() override;
 
+    void ApplyAttributes() override;
 
   protected:
     void OnNodeSet(Urho3D::Node * node) override;
 
+    void OnSceneSet(Urho3D::Scene * scene) override;
+
     void OnMarkedDirty(Urho3D::Node * node) override;
 
     void set_spaces(const Urho3D::VariantVector & spaces);
 
-    Urho3D::VariantVector get_spaces() const;
+    const Urho3D::VariantVector & get_spaces() const;
 
-  private:
-    fvec3 old_position_;
+    // Swap to the cached rotated footprint without touching the grid - the grid calls this while the spaces are out
+    void _apply_rotation_step(int step);
 
+    void _invalidate_grid_debug();
+
+    void _swap_footprint(Tile_Footprint * footprint);
+
+    Tile_Footprint * _own_footprint() const;
+
+    void _update_compound_footprint();
+
+    void _dissolve_compound();
+
+    void _absorb(Tile_Occupier * root);
+
+    void _child_released(Tile_Occupier * child);
+
+  private:
     bool draw_debug_;
 
+    bool footprint_from_model_;
+
+    int rotation_step_;
+
+    bool compound_;
+
     Urho3D::String scoobers;
 
     int coolio;
 
-    Urho3D::Vector<ivec3> spaces_;
+    // Registered with the grid - for a compound root this is the union footprint
+    Urho3D::SharedPtr<Tile_Footprint> footprint_;
+
+    // The root's own spaces while it is acting as a compound, null otherwise
+    Urho3D::SharedPtr<Tile_Footprint> own_footprint_;
+
+    Urho3D::WeakPtr<Tile_Occupier> compound_root_;
+
+    Urho3D::Vector<Urho3D::WeakPtr<Tile_Occupier>> compound_children_;
+
+    // Grid the occupier is registered with - kept so it can take itself out once it has already left the scene
+    Urho3D::WeakPtr<Hex_Tile_Grid> grid_;
 };
@@ -0,0 +1,49 @@
+#include <tile_save_scope.h>
+#include <buried_tile_culler.h>
+#include <chunk_mesh_baker.h>
+#include <tile_batcher.h>
+
+#include <Urho3D/Graphics/StaticModel.h>
+#include <Urho3D/Scene/Scene.h>
+
+using namespace Urho3D;
+
+Tile_Save_Scope::Tile_Save_Scope(Urho3D::Node * root)
+{
+    Scene * scn = (root != nullptr) ? root->GetScene() : nullptr;
+    if (scn == nullptr)
+        return;
+
+    Tile_Batcher * batcher = scn->GetComponent<Tile_Batcher>();
+    Chunk_Mesh_Baker * baker = scn->GetComponent<Chunk_Mesh_Baker>();
+    Buried_Tile_Culler * culler = scn->GetComponent<Buried_Tile_Culler>();
+    if (batcher == nullptr && baker == nullptr && culler == nullptr)
+        return;
+
+    PODVector<Node *> nodes;
+    root->GetChildrenWithComponent<StaticModel>(nodes, true);
+    if (root->HasComponent<StaticModel>())
+        nodes.Push(root);
+
+    for (uint32_t i = 0; i < nodes.Size(); ++i)
+    {
+        Node * nd = nodes[i];
+        bool hidden = (batcher != nullptr && batcher->is_batched(nd)) || (baker != nullptr && baker->is_baked(nd)) ||
+                      (culler != nullptr && culler->is_buried(nd));
+        StaticModel * sm = nd->GetComponent<StaticModel>();
+        if (hidden && !sm->IsEnabled())
+        {
+            sm->SetEnabled(true);
+            shown_.Push(WeakPtr<StaticModel>(sm));
+        }
+    }
+}
+
+Tile_Save_Scope::~Tile_Save_Scope()
+{
+    for (uint32_t i = 0; i < shown_.Size(); ++i)
+    {
+        if (shown_[i] != nullptr)
+            shown_[i]->SetEnabled(false);
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Container/Vector.h>
+
+namespace Urho3D
+{
+class Node;
+class StaticModel;
+} // namespace Urho3D
+
+/*!
+Shows the tiles under a node that the Tile_Batcher, Chunk_Mesh_Baker or Buried_Tile_Culler have hidden for as long as
+the scope is alive, and hides them again when it goes. Those components hide a tile by disabling its StaticModel,
+which is a saved attribute - so any save of a node or scene holding tiles has to happen inside one of these or the
+tiles come back invisible when loaded or pasted.
+*/
+class Tile_Save_Scope
+{
+  public:
+    Tile_Save_Scope(Urho3D::Node * root);
+    ~Tile_Save_Scope();
+
+  private:
+    Urho3D::Vector<Urho3D::WeakPtr<Urho3D::StaticModel>> shown_;
+};
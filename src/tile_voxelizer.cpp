@@ -0,0 +1,266 @@
+#include <tile_voxelizer.h>
+#include <tile_occupier.h>
+#include <hex_tile_grid.h>
+#include <mtdebug_print.h>
+
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Graphics/Geometry.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Graphics/VertexBuffer.h>
+
+using namespace Urho3D;
+
+Tile_Voxelizer::Tile_Voxelizer(Urho3D::Context * context) : Object(context)
+{
+    SubscribeToEvent(E_WORKITEMCOMPLETED, URHO3D_HANDLER(Tile_Voxelizer, handle_work_item_completed));
+}
+
+Tile_Voxelizer::~Tile_Voxelizer()
+{
+    // Jobs still in the queue point at memory we own, so wait for them before freeing it
+    WorkQueue * queue = GetSubsystem<WorkQueue>();
+    if (queue != nullptr && !running_.Empty())
+        queue->Complete(0);
+
+    auto iter = running_.Begin();
+    while (iter != running_.End())
+    {
+        delete iter->second_;
+        ++iter;
+    }
+}
+
+void Tile_Voxelizer::request(Tile_Occupier * occ, Urho3D::Model * model, int step)
+{
+    if (occ == nullptr || model == nullptr)
+        return;
+
+    Tile_Footprint * fp = cached(model);
+    if (fp != nullptr)
+    {
+        waiting_.Erase(occ);
+        occ->set_base_footprint(fp, step);
+        return;
+    }
+
+    // A later request for the same occupier replaces the earlier one
+    Waiting_Occupier & waiting = waiting_[occ];
+    waiting.occ_ = occ;
+    waiting.model_name_ = model->GetNameHash();
+    waiting.rotation_step_ = step;
+
+    if (running_.Contains(model->GetNameHash()))
+        return;
+
+    WorkQueue * queue = GetSubsystem<WorkQueue>();
+    if (queue == nullptr)
+    {
+        waiting_.Erase(occ);
+        occ->set_base_footprint(voxelize(model), step);
+        return;
+    }
+
+    Voxel_Job * job = _create_job(model);
+    running_[job->model_name_] = job;
+
+    // Lowest priority - the renderer only waits on max priority items each frame so this never stalls a frame
+    SharedPtr<WorkItem> item = queue->GetFreeItem();
+    item->workFunction_ = _run_job;
+    item->aux_ = job;
+    item->priority_ = 0;
+    item->sendEvent_ = true;
+    queue->AddWorkItem(item);
+}
+
+Urho3D::SharedPtr<Tile_Footprint> Tile_Voxelizer::voxelize(Urho3D::Model * model)
+{
+    if (model == nullptr)
+        return Tile_Footprint::single_cell();
+
+    Tile_Footprint * fp = cached(model);
+    if (fp != nullptr)
+        return SharedPtr<Tile_Footprint>(fp);
+
+    Voxel_Job * job = _create_job(model);
+    _voxelize(job);
+    fp = _store(job->model_name_, job->result_);
+    delete job;
+    return SharedPtr<Tile_Footprint>(fp);
+}
+
+Tile_Footprint * Tile_Voxelizer::cached(Urho3D::Model * model) const
+{
+    if (model == nullptr)
+        return nullptr;
+
+    auto iter = cache_.Find(model->GetNameHash());
+    if (iter == cache_.End())
+        return nullptr;
+    return iter->second_;
+}
+
+void Tile_Voxelizer::clear_cache()
+{
+    cache_.Clear();
+}
+
+uint32_t Tile_Voxelizer::pending_count() const
+{
+    return waiting_.Size();
+}
+
+void Tile_Voxelizer::handle_work_item_completed(Urho3D::StringHash event_type, Urho3D::VariantMap & event_data)
+{
+    using namespace WorkItemCompleted;
+
+    WorkItem * item = static_cast<WorkItem *>(event_data[P_ITEM].GetVoidPtr());
+    if (item == nullptr || item->workFunction_ != _run_job)
+        return;
+
+    Voxel_Job * job = static_cast<Voxel_Job *>(item->aux_);
+    auto run_iter = running_.Find(job->model_name_);
+    if (run_iter == running_.End() || run_iter->second_ != job)
+        return;
+    running_.Erase(run_iter);
+
+    SharedPtr<Tile_Footprint> fp(_store(job->model_name_, job->result_));
+
+    auto iter = waiting_.Begin();
+    while (iter != waiting_.End())
+    {
+        Waiting_Occupier & waiting = iter->second_;
+        if (waiting.occ_.Expired())
+        {
+            iter = waiting_.Erase(iter);
+        }
+        else if (waiting.model_name_ == job->model_name_)
+        {
+            waiting.occ_->set_base_footprint(fp, waiting.rotation_step_);
+            iter = waiting_.Erase(iter);
+        }
+        else
+        {
+            ++iter;
+        }
+    }
+    delete job;
+}
+
+Tile_Voxelizer::Voxel_Job * Tile_Voxelizer::_create_job(Urho3D::Model * model)
+{
+    Voxel_Job * job = new Voxel_Job;
+    job->model_name_ = model->GetNameHash();
+
+    // Copy the lod 0 triangles out now - the worker should not be reading the model while the main thread owns it
+    for (uint32_t g = 0; g < model->GetNumGeometries(); ++g)
+    {
+        Geometry * geom = model->GetGeometry(g, 0);
+        if (geom == nullptr || geom->GetPrimitiveType() != TRIANGLE_LIST)
+            continue;
+
+        const unsigned char * vert_data = nullptr;
+        const unsigned char * ind_data = nullptr;
+        const PODVector<VertexElement> * elements = nullptr;
+        unsigned vert_size = 0;
+        unsigned ind_size = 0;
+        geom->GetRawData(vert_data, vert_size, ind_data, ind_size, elements);
+        if (vert_data == nullptr || elements == nullptr)
+        {
+            wout << "Model" << model->GetName() << "geometry" << g << "has no shadow data to voxelize";
+            continue;
+        }
+
+        unsigned pos_offset = VertexBuffer::GetElementOffset(*elements, TYPE_VECTOR3, SEM_POSITION);
+        if (pos_offset == M_MAX_UNSIGNED)
+            continue;
+
+        if (ind_data != nullptr)
+        {
+            uint32_t end = geom->GetIndexStart() + geom->GetIndexCount();
+            for (uint32_t i = geom->GetIndexStart(); i < end; ++i)
+            {
+                uint32_t vert = (ind_size == sizeof(unsigned short)) ? ((const unsigned short *)ind_data)[i]
+                                                                     : ((const uint32_t *)ind_data)[i];
+                job->triangles_.Push(*(const fvec3 *)(vert_data + vert * vert_size + pos_offset));
+            }
+        }
+        else
+        {
+            uint32_t end = geom->GetVertexStart() + geom->GetVertexCount();
+            for (uint32_t i = geom->GetVertexStart(); i < end; ++i)
+                job->triangles_.Push(*(const fvec3 *)(vert_data + i * vert_size + pos_offset));
+        }
+    }
+    return job;
+}
+
+Tile_Footprint * Tile_Voxelizer::_store(const Urho3D::StringHash & model_name, const Urho3D::Vector<ivec3> & spaces)
+{
+    SharedPtr<Tile_Footprint> & fp = cache_[model_name];
+    if (spaces.Empty())
+        fp = Tile_Footprint::single_cell();
+    else
+        fp = Tile_Footprint::intern(spaces);
+    return fp;
+}
+
+void Tile_Voxelizer::_run_job(const Urho3D::WorkItem * item, uint32_t thread_index)
+{
+    _voxelize(static_cast<Voxel_Job *>(item->aux_));
+}
+
+void Tile_Voxelizer::_voxelize(Voxel_Job * job)
+{
+    const PODVector<fvec3> & tris = job->triangles_;
+    if (tris.Size() < 3)
+        return;
+
+    fbbox bounds;
+    for (uint32_t i = 0; i < tris.Size(); ++i)
+        bounds.Merge(tris[i]);
+    fvec3 center = bounds.Center();
+
+    // Lowest and highest occupied z for each grid column
+    HashMap<ivec2, ivec2> columns;
+    for (uint32_t t = 0; t + 2 < tris.Size(); t += 3)
+    {
+        const fvec3 & a = tris[t];
+        fvec3 ab = tris[t + 1] - a;
+        fvec3 ac = tris[t + 2] - a;
+        float longest = Max(Max(ab.Length(), ac.Length()), (ac - ab).Length());
+        int samples = Clamp(int(std::ceil(longest / VOXEL_SAMPLE_SPACING)), 1, VOXEL_MAX_TRIANGLE_SAMPLES);
+
+        for (int i = 0; i <= samples; ++i)
+        {
+            for (int j = 0; i + j <= samples; ++j)
+            {
+                fvec3 pnt = a + ab * (float(i) / samples) + ac * (float(j) / samples);
+                fvec3 to_center = center - pnt;
+                pnt.x_ += Clamp(to_center.x_, -VOXEL_INSET, VOXEL_INSET);
+                pnt.y_ += Clamp(to_center.y_, -VOXEL_INSET, VOXEL_INSET);
+                pnt.z_ += Clamp(to_center.z_, -VOXEL_INSET, VOXEL_INSET);
+
+                ivec3 cell = Hex_Tile_Grid::world_to_grid(pnt);
+                ivec2 col(cell.x_, cell.y_);
+                auto iter = columns.Find(col);
+                if (iter == columns.End())
+                {
+                    columns[col] = ivec2(cell.z_, cell.z_);
+                }
+                else
+                {
+                    iter->second_.x_ = Min(iter->second_.x_, cell.z_);
+                    iter->second_.y_ = Max(iter->second_.y_, cell.z_);
+                }
+            }
+        }
+    }
+
+    auto iter = columns.Begin();
+    while (iter != columns.End())
+    {
+        for (int z = iter->second_.x_; z <= iter->second_.y_; ++z)
+            job->result_.Push(ivec3(iter->first_.x_, iter->first_.y_, z));
+        ++iter;
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+const int VOXEL_MAX_TRIANGLE_SAMPLES = 256;
+const float VOXEL_SAMPLE_SPACING = 0.2f;
+const float VOXEL_INSET = 0.02f;
+
+#include <Urho3D/Core/Object.h>
+#include <tile_footprint.h>
+
+namespace Urho3D
+{
+class Model;
+struct WorkItem;
+} // namespace Urho3D
+
+class Tile_Occupier;
+
+/*!
+Subsystem which turns model geometry into hex grid footprints. Triangles are sampled on a worker thread and every
+cell a sample lands in is occupied, then each grid column is filled between its lowest and highest occupied cell so
+solid buildings do not come out hollow. Samples are pulled VOXEL_INSET towards the model centre first so faces lying
+exactly on a cell boundary do not spill into the neighbouring cell.
+
+Models are only voxelized unrotated and the result is cached per model - a thousand instances of the same building
+voxelize once. Occupiers are handed this base footprint and pick the rotated variant for their node from it, so every
+60 degree orientation is served from the same voxelization. Node scale is not taken in to account.
+*/
+class Tile_Voxelizer : public Urho3D::Object
+{
+    URHO3D_OBJECT(Tile_Voxelizer, Urho3D::Object);
+
+  public:
+    Tile_Voxelizer(Urho3D::Context * context);
+    ~Tile_Voxelizer();
+
+    // Give occ the base footprint for model rotated by step - immediately if cached, otherwise once the worker thread
+    // is done with it
+    void request(Tile_Occupier * occ, Urho3D::Model * model, int step);
+
+    // Voxelize on the calling thread, using and filling the cache
+    Urho3D::SharedPtr<Tile_Footprint> voxelize(Urho3D::Model * model);
+
+    Tile_Footprint * cached(Urho3D::Model * model) const;
+
+    void clear_cache();
+
+    uint32_t pending_count() const;
+
+  private:
+    struct Voxel_Job
+    {
+        Urho3D::StringHash model_name_;
+        // Triangle list copied out of the model's shadow data on the main thread
+        Urho3D::PODVector<fvec3> triangles_;
+        Urho3D::Vector<ivec3> result_;
+    };
+
+    struct Waiting_Occupier
+    {
+        Urho3D::WeakPtr<Tile_Occupier> occ_;
+        Urho3D::StringHash model_name_;
+        // Rotation step of the occupier's node when it asked
+        int rotation_step_;
+    };
+
+    void handle_work_item_completed(Urho3D::StringHash event_type, Urho3D::VariantMap & event_data);
+
+    Voxel_Job * _create_job(Urho3D::Model * model);
+
+    Tile_Footprint * _store(const Urho3D::StringHash & model_name, const Urho3D::Vector<ivec3> & spaces);
+
+    static void _run_job(const Urho3D::WorkItem * item, uint32_t thread_index);
+
+    static void _voxelize(Voxel_Job * job);
+
+    Urho3D::HashMap<Urho3D::StringHash, Urho3D::SharedPtr<Tile_Footprint>> cache_;
+
+    Urho3D::HashMap<Urho3D::StringHash, Voxel_Job *> running_;
+
+    Urho3D::HashMap<Tile_Occupier *, Waiting_Occupier> waiting_;
+};
@@ -0,0 +1,183 @@
+#include <Urho3D/Scene/Node.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Graphics/StaticModel.h>
+
+#include "attribute_index.h"
+#include "selector.h"
+
+using namespace Urho3D;
+
+namespace bbtk
+{
+
+Attribute_Index::Attribute_Index()
+{}
+
+void Attribute_Index::add(Urho3D::Node * node)
+{
+    if (node == nullptr)
+        return;
+
+    auto iter = entries_.Find(node);
+    if (iter != entries_.End())
+    {
+        // A new node allocated where a deleted one used to be - drop the stale keys first
+        if (iter->second_.node_.Expired())
+        {
+            _unlink(node, iter->second_);
+            iter->second_.node_ = node;
+        }
+    }
+    else
+    {
+        entries_[node].node_ = node;
+    }
+    dirty_.Insert(node);
+}
+
+void Attribute_Index::remove(Urho3D::Node * node)
+{
+    auto iter = entries_.Find(node);
+    if (iter == entries_.End())
+        return;
+
+    _unlink(node, iter->second_);
+    entries_.Erase(iter);
+    dirty_.Erase(node);
+}
+
+void Attribute_Index::mark_dirty(Urho3D::Node * node)
+{
+    if (entries_.Contains(node))
+        dirty_.Insert(node);
+}
+
+void Attribute_Index::clear()
+{
+    entries_.Clear();
+    dirty_.Clear();
+    for (int i = 0; i < ATTR_KIND_COUNT; ++i)
+        buckets_[i].Clear();
+}
+
+bool Attribute_Index::contains(Urho3D::Node * node) const
+{
+    return entries_.Contains(node);
+}
+
+void Attribute_Index::query(Attribute_Kind kind, const Urho3D::StringHash & key, Urho3D::PODVector<Urho3D::Node *> & out)
+{
+    _flush();
+
+    auto bucket_iter = buckets_[kind].Find(key);
+    if (bucket_iter == buckets_[kind].End())
+        return;
+
+    PODVector<Node *> expired;
+    const HashSet<Node *> & bucket = bucket_iter->second_;
+    out.Reserve(out.Size() + bucket.Size());
+    auto iter = bucket.Begin();
+    while (iter != bucket.End())
+    {
+        if (entries_[*iter].node_.Expired())
+            expired.Push(*iter);
+        else
+            out.Push(*iter);
+        ++iter;
+    }
+
+    for (uint32_t i = 0; i < expired.Size(); ++i)
+        remove(expired[i]);
+}
+
+void Attribute_Index::gather_keys(Urho3D::Node * node, Attribute_Kind kind, Urho3D::PODVector<Urho3D::StringHash> & out)
+{
+    if (kind == ATTR_TAG)
+    {
+        const StringVector & tags = node->GetTags();
+        for (uint32_t i = 0; i < tags.Size(); ++i)
+            out.Push(StringHash(tags[i]));
+        return;
+    }
+
+    StaticModel * sm = node->GetComponent<StaticModel>();
+    if (sm == nullptr)
+        return;
+
+    if (kind == ATTR_MODEL)
+    {
+        if (sm->GetModel() != nullptr)
+            out.Push(sm->GetModel()->GetNameHash());
+        return;
+    }
+
+    // A selected node's model draws with the Selector's outline clones - index the materials they stand in for
+    Selector * sel = node->GetComponent<Selector>();
+    for (uint32_t i = 0; i < sm->GetNumGeometries(); ++i)
+    {
+        Material * mat = (sel != nullptr) ? sel->base_material(i) : sm->GetMaterial(i);
+        if (mat != nullptr && !out.Contains(mat->GetNameHash()))
+            out.Push(mat->GetNameHash());
+    }
+}
+
+uint32_t Attribute_Index::size() const
+{
+    return entries_.Size();
+}
+
+void Attribute_Index::_flush()
+{
+    auto iter = dirty_.Begin();
+    while (iter != dirty_.End())
+    {
+        Node * nd = *iter;
+        ++iter;
+
+        auto entry_iter = entries_.Find(nd);
+        if (entry_iter == entries_.End())
+            continue;
+
+        Node_Entry & entry = entry_iter->second_;
+        _unlink(nd, entry);
+        if (entry.node_.Expired())
+        {
+            entries_.Erase(entry_iter);
+            continue;
+        }
+
+        for (int k = 0; k < ATTR_KIND_COUNT; ++k)
+            gather_keys(nd, Attribute_Kind(k), entry.keys_[k]);
+        _link(nd, entry);
+    }
+    dirty_.Clear();
+}
+
+void Attribute_Index::_link(Urho3D::Node * node, Node_Entry & entry)
+{
+    for (int k = 0; k < ATTR_KIND_COUNT; ++k)
+    {
+        for (uint32_t i = 0; i < entry.keys_[k].Size(); ++i)
+            buckets_[k][entry.keys_[k][i]].Insert(node);
+    }
+}
+
+void Attribute_Index::_unlink(Urho3D::Node * node, Node_Entry & entry)
+{
+    for (int k = 0; k < ATTR_KIND_COUNT; ++k)
+    {
+        for (uint32_t i = 0; i < entry.keys_[k].Size(); ++i)
+        {
+            auto bucket_iter = buckets_[k].Find(entry.keys_[k][i]);
+            if (bucket_iter == buckets_[k].End())
+                continue;
+
+            bucket_iter->second_.Erase(node);
+            if (bucket_iter->second_.Empty())
+                buckets_[k].Erase(bucket_iter);
+        }
+        entry.keys_[k].Clear();
+    }
+}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/HashSet.h>
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Math/StringHash.h>
+
+namespace Urho3D
+{
+class Node;
+} // namespace Urho3D
+
+namespace bbtk
+{
+
+enum Attribute_Kind
+{
+    // Name of the node's StaticModel model
+    ATTR_MODEL,
+    // Name of any of the node's StaticModel materials
+    ATTR_MATERIAL,
+    // Any of the node's tags
+    ATTR_TAG,
+    ATTR_KIND_COUNT
+};
+
+/*!
+Reverse lookup from model, material and tag names to the nodes carrying them. Nodes are added and removed as their
+Selector or Tile_Occupier comes and goes, but their keys are only read the next time the index is queried - a node is
+usually added before its model and materials are loaded, and this way a scene load costs one key gather per node no
+matter how many components each node gets.
+
+Changing a model, material or tag after the node is indexed needs a mark_dirty (tags are handled by the owner
+listening for the tag events). Removed nodes are caught on query even if remove was never called, so a lookup costs
+the size of its result and never a walk over the scene.
+*/
+class Attribute_Index
+{
+  public:
+    Attribute_Index();
+
+    void add(Urho3D::Node * node);
+
+    void remove(Urho3D::Node * node);
+
+    // Re-read the node's keys on the next query - does nothing for nodes that are not indexed
+    void mark_dirty(Urho3D::Node * node);
+
+    void clear();
+
+    bool contains(Urho3D::Node * node) const;
+
+    // Fill out with every live node carrying key
+    void query(Attribute_Kind kind, const Urho3D::StringHash & key, Urho3D::PODVector<Urho3D::Node *> & out);
+
+    // Fill out with node's keys of kind - the node does not need to be indexed
+    static void gather_keys(Urho3D::Node * node, Attribute_Kind kind, Urho3D::PODVector<Urho3D::StringHash> & out);
+
+    uint32_t size() const;
+
+  private:
+    struct Node_Entry
+    {
+        Urho3D::WeakPtr<Urho3D::Node> node_;
+        Urho3D::PODVector<Urho3D::StringHash> keys_[ATTR_KIND_COUNT];
+    };
+
+    void _flush();
+
+    void _link(Urho3D::Node * node, Node_Entry & entry);
+
+    void _unlink(Urho3D::Node * node, Node_Entry & entry);
+
+    Urho3D::HashMap<Urho3D::Node *, Node_Entry> entries_;
+
+    Urho3D::HashMap<Urho3D::StringHash, Urho3D::HashSet<Urho3D::Node *>> buckets_[ATTR_KIND_COUNT];
+
+    Urho3D::HashSet<Urho3D::Node *> dirty_;
+};
+}
@@ -30,6 +30,10 @@
 
 #include <tile_occupier.h>
 #include <hex_tile_grid.h>
+#include <tile_batcher.h>
+#include <chunk_mesh_baker.h>
+#include <buried_tile_culler.h>
+#include <tile_voxelizer.h>
 #include <input_translator.h>
 #include <mtdebug_print.h>
 #include <input_translator.h>
@@ -77,6 +81,10 @@ namespace bbtk
 
     void BBToolkit::handle_post_render_update(StringHash event_type, VariantMap &event_data)
     {
+        Hex_Tile_Grid *tg = (scene_ != nullptr) ? scene_->GetComponent<Hex_Tile_Grid>() : nullptr;
+        if (tg != nullptr)
+            tg->push_hud_stats(GetSubsystem<DebugHud>());
+
         if (draw_debug_)
         {
             if (scene_ != nullptr)
@@ -145,6 +153,9 @@ namespace bbtk
         // Scene root components
         Selection_Controller::register_context(context_);
         Hex_Tile_Grid::register_context(context_);
+        Tile_Batcher::register_context(context_);
+        Chunk_Mesh_Baker::register_context(context_);
+        Buried_Tile_Culler::register_context(context_);
 
         // Per node components
         Tile_Occupier::register_context(context_);
@@ -158,6 +169,7 @@ namespace bbtk
 
         context_->RegisterSubsystem(new Script(context_));
         context_->RegisterSubsystem(new LuaScript(context_));
+        context_->RegisterSubsystem(new Tile_Voxelizer(context_));
 
         input_translator_->init();
         camera_controller_->init();
@@ -237,6 +249,17 @@ namespace bbtk
         scene_->CreateComponent<Octree>();
         PhysicsWorld *phys = scene_->CreateComponent<PhysicsWorld>();
         Hex_Tile_Grid *tg = scene_->CreateComponent<Hex_Tile_Grid>();
+        tg->set_deferred_updates(true);
+
+        // Tiles closed in on every side and above are hidden - created first so the batcher and baker see what it hid
+        // in the same update. F6 toggles it
+        scene_->CreateComponent<Buried_Tile_Culler>();
+
+        // One StaticModelGroup per chunk, model and material instead of a StaticModel per tile - F4 toggles it
+        scene_->CreateComponent<Tile_Batcher>();
+
+        // Terrain tiles are merged in to one mesh per chunk with the faces buried between them dropped - F5 toggles it
+        scene_->CreateComponent<Chunk_Mesh_Baker>();
         Selection_Controller *editor_selection = scene_->CreateComponent<Selection_Controller>();
         phys->SetGravity(fvec3(0.0f, 0.0f, -9.81f));
 
@@ -296,16 +319,9 @@ namespace bbtk
         light->SetSpecularIntensity(5.0f);
         light->SetBrightness(1.0f);
 
-        Technique *tech = cache->GetResource<Technique>("Techniques/DiffNormal.xml");
-        Technique *tech_outline = cache->GetResource<Technique>("Techniques/DiffNormalOutline.xml");
-
+        // Selected tiles use an outline variant of this made by Selector
         Material *grass_tile = cache->GetResource<Material>("Materials/Tiles/Grass.xml");
-        Material *grass_tile_selected =
-            cache->GetResource<Material>("Materials/Tiles/GrassSelected.xml");
-        grass_tile_selected->SetShaderParameter("OutlineEnable", true);
 
-        //<parameter name="OutlineWidth" value="0.01" />
-        //<parameter name="OutlineColor" value="1 1 0 1" />
         Model *mod = cache->GetResource<Model>("Models/Tiles/Grass.mdl");
 
         Input_Context *in_context = input_map_->create_context("global_context");
@@ -327,10 +343,8 @@ namespace bbtk
                     modc->SetModel(mod);
                     modc->SetMaterial(grass_tile);
 
-                    Selector *sel = tile_node->CreateComponent<Selector>();
-                    sel->SetModel(mod);
-                    sel->SetMaterial(grass_tile_selected);
-                    sel->set_selected(false);
+                    tile_node->AddTag(STATIC_TERRAIN_TAG);
+                    tile_node->CreateComponent<Selector>();
 
                     CollisionShape *cs = tile_node->CreateComponent<CollisionShape>();
                     const BoundingBox &bb = modc->GetBoundingBox();
@@ -395,6 +409,18 @@ namespace bbtk
         it.condition_.key_ = KEY_DELETE;
         it.name_ = "DeleteSelection";
         ctxt->create_trigger(it);
+
+        it.condition_.key_ = KEY_F4;
+        it.name_ = "ToggleTileBatching";
+        ctxt->create_trigger(it);
+
+        it.condition_.key_ = KEY_F5;
+        it.name_ = "ToggleMeshBaking";
+        ctxt->create_trigger(it);
+
+        it.condition_.key_ = KEY_F6;
+        it.name_ = "ToggleBuriedCulling";
+        ctxt->create_trigger(it);
     }
 
     void BBToolkit::handle_scene_update(StringHash /*eventType*/, VariantMap &event_data)
@@ -427,6 +453,24 @@ namespace bbtk
         {
             draw_debug_ = !draw_debug_;
         }
+        else if (name == StringHash("ToggleTileBatching"))
+        {
+            Tile_Batcher *tb = scene_->GetComponent<Tile_Batcher>();
+            if (tb != nullptr)
+                tb->SetEnabled(!tb->IsEnabled());
+        }
+        else if (name == StringHash("ToggleMeshBaking"))
+        {
+            Chunk_Mesh_Baker *cmb = scene_->GetComponent<Chunk_Mesh_Baker>();
+            if (cmb != nullptr)
+                cmb->SetEnabled(!cmb->IsEnabled());
+        }
+        else if (name == StringHash("ToggleBuriedCulling"))
+        {
+            Buried_Tile_Culler *btc = scene_->GetComponent<Buried_Tile_Culler>();
+            if (btc != nullptr)
+                btc->SetEnabled(!btc->IsEnabled());
+        }
         else if (name == StringHash("TakeScreenshot"))
         {
             Graphics *graphics = GetSubsystem<Graphics>();
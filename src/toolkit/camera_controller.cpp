@@ -155,8 +155,10 @@ void Camera_Controller::setup_input_context(Input_Context * ctxt)
     it.name_ = "CameraLeft";
     ctxt->create_trigger(it);
 
+    // Ctrl+D duplicates the selection
     it.condition_.key_ = KEY_D;
     it.name_ = "CameraRight";
+    it.qual_allowed_ = QUAL_SHIFT | QUAL_ALT;
     ctxt->create_trigger(it);
 
     it.condition_.key_ = 0;
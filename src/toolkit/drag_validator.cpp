@@ -0,0 +1,226 @@
+#include <Urho3D/Scene/Node.h>
+
+#include "drag_validator.h"
+#include "selector.h"
+
+#include <hex_tile_grid.h>
+#include <tile_occupier.h>
+
+using namespace Urho3D;
+
+namespace bbtk
+{
+
+Drag_Validator::Drag_Validator() : grid_(nullptr), grid_revision_(0), blocked_count_(0)
+{}
+
+void Drag_Validator::begin(Hex_Tile_Grid * grid, const Urho3D::HashSet<Urho3D::Node *> & selection)
+{
+    clear();
+    grid_ = grid;
+    if (grid_ == nullptr)
+        return;
+
+    grid_->flush_updates();
+    grid_revision_ = grid_->revision();
+    grid_->chunk_revisions(chunk_revs_);
+
+    entries_.Reserve(selection.Size());
+    auto iter = selection.Begin();
+    while (iter != selection.End())
+    {
+        Node * nd = *iter;
+        excluded_ids_.Insert(nd->GetID());
+
+        Tile_Occupier * occ = nd->GetComponent<Tile_Occupier>();
+        if (occ != nullptr)
+        {
+            Drag_Entry entry;
+            entry.node_ = nd;
+            entry.occ_ = occ;
+            entry.selector_ = nd->GetComponent<Selector>();
+            entry.tested_ = false;
+            entry.blocked_ = false;
+            entries_.Push(entry);
+        }
+        ++iter;
+    }
+}
+
+void Drag_Validator::clear()
+{
+    for (uint32_t i = 0; i < entries_.Size(); ++i)
+    {
+        if (entries_[i].blocked_ && entries_[i].selector_ != nullptr)
+            entries_[i].selector_->set_outline_state(Selector::OUTLINE_NORMAL);
+    }
+
+    grid_ = nullptr;
+    entries_.Clear();
+    excluded_ids_.Clear();
+    chunk_revs_.Clear();
+    grid_revision_ = 0;
+    blocked_count_ = 0;
+}
+
+bool Drag_Validator::active() const
+{
+    return grid_ != nullptr;
+}
+
+bool Drag_Validator::update()
+{
+    if (grid_ == nullptr)
+        return false;
+
+    // The selection's moves have to land before the revisions are read
+    grid_->flush_updates();
+    HashSet<ivec3> outside;
+    if (grid_->revision() != grid_revision_)
+    {
+        HashMap<ivec3, uint32_t> revs;
+        grid_->chunk_revisions(revs);
+        _outside_changes(revs, outside);
+        chunk_revs_ = revs;
+        grid_revision_ = grid_->revision();
+    }
+
+    bool changed = false;
+    for (uint32_t i = 0; i < entries_.Size(); ++i)
+    {
+        Drag_Entry & entry = entries_[i];
+        Node * nd = entry.node_;
+        Tile_Occupier * occ = entry.occ_;
+        if (nd == nullptr || occ == nullptr || !occ->IsEnabled())
+        {
+            if (entry.blocked_)
+            {
+                _set_blocked(entry, false);
+                changed = true;
+            }
+            entry.tested_ = false;
+            continue;
+        }
+
+        Tile_Footprint * fp = occ->footprint();
+        ivec3 cell = Hex_Tile_Grid::world_to_grid(nd->GetWorldPosition());
+        if (entry.tested_ && cell == entry.cell_ && fp == entry.footprint_ &&
+            (outside.Empty() || !_touches(fp, cell, outside)))
+            continue;
+
+        bool blocked = _test(fp, cell);
+        entry.footprint_ = fp;
+        entry.cell_ = cell;
+        entry.tested_ = true;
+        if (blocked != entry.blocked_)
+        {
+            _set_blocked(entry, blocked);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+uint32_t Drag_Validator::blocked_count() const
+{
+    return blocked_count_;
+}
+
+bool Drag_Validator::_test(Tile_Footprint * footprint, const ivec3 & cell) const
+{
+    if (footprint == nullptr)
+        return false;
+
+    const Vector<ivec3> & spaces = footprint->spaces();
+    for (uint32_t i = 0; i < spaces.Size(); ++i)
+    {
+        if (grid_->occupied_excluding(Hex_Tile_Grid::space_cell(spaces[i], cell), excluded_ids_))
+            return true;
+    }
+    return false;
+}
+
+void Drag_Validator::_outside_changes(const Urho3D::HashMap<ivec3, uint32_t> & revs,
+                                      Urho3D::HashSet<ivec3> & out) const
+{
+    // Moving a registered node takes its item out of each old cell and puts it in each new one - one bump per cell
+    HashMap<ivec3, uint32_t> own_bumps;
+    for (uint32_t i = 0; i < entries_.Size(); ++i)
+    {
+        const Drag_Entry & entry = entries_[i];
+        Node * nd = entry.node_;
+        Tile_Occupier * occ = entry.occ_;
+        if (!entry.tested_ || entry.footprint_ == nullptr || nd == nullptr || occ == nullptr ||
+            !grid_->occupier_registered(occ))
+            continue;
+
+        Tile_Footprint * fp = occ->footprint();
+        ivec3 cell = Hex_Tile_Grid::world_to_grid(nd->GetWorldPosition());
+        if (cell == entry.cell_ && fp == entry.footprint_)
+            continue;
+
+        const Vector<ivec3> & old_spaces = entry.footprint_->spaces();
+        for (uint32_t s = 0; s < old_spaces.Size(); ++s)
+            ++own_bumps[Hex_Tile_Grid::chunk_key(Hex_Tile_Grid::space_cell(old_spaces[s], entry.cell_))];
+
+        const Vector<ivec3> & new_spaces = fp->spaces();
+        for (uint32_t s = 0; s < new_spaces.Size(); ++s)
+            ++own_bumps[Hex_Tile_Grid::chunk_key(Hex_Tile_Grid::space_cell(new_spaces[s], cell))];
+    }
+
+    // Anything the selection does not account for exactly - including chunks allocated since - was changed by
+    // something else
+    auto rev_iter = revs.Begin();
+    while (rev_iter != revs.End())
+    {
+        auto prev_iter = chunk_revs_.Find(rev_iter->first_);
+        if (prev_iter == chunk_revs_.End())
+        {
+            out.Insert(rev_iter->first_);
+        }
+        else if (prev_iter->second_ != rev_iter->second_)
+        {
+            auto bump_iter = own_bumps.Find(rev_iter->first_);
+            uint32_t own = (bump_iter != own_bumps.End()) ? bump_iter->second_ : 0;
+            if (rev_iter->second_ - prev_iter->second_ != own)
+                out.Insert(rev_iter->first_);
+        }
+        ++rev_iter;
+    }
+
+    // Released chunks are empty now, so whatever blocked a node there has gone
+    rev_iter = chunk_revs_.Begin();
+    while (rev_iter != chunk_revs_.End())
+    {
+        if (!revs.Contains(rev_iter->first_))
+            out.Insert(rev_iter->first_);
+        ++rev_iter;
+    }
+}
+
+bool Drag_Validator::_touches(Tile_Footprint * footprint, const ivec3 & cell, const Urho3D::HashSet<ivec3> & chunks)
+{
+    if (footprint == nullptr)
+        return false;
+
+    const Vector<ivec3> & spaces = footprint->spaces();
+    for (uint32_t i = 0; i < spaces.Size(); ++i)
+    {
+        if (chunks.Contains(Hex_Tile_Grid::chunk_key(Hex_Tile_Grid::space_cell(spaces[i], cell))))
+            return true;
+    }
+    return false;
+}
+
+void Drag_Validator::_set_blocked(Drag_Entry & entry, bool blocked)
+{
+    entry.blocked_ = blocked;
+    if (blocked)
+        ++blocked_count_;
+    else
+        --blocked_count_;
+
+    if (entry.selector_ != nullptr)
+        entry.selector_->set_outline_state(blocked ? Selector::OUTLINE_BLOCKED : Selector::OUTLINE_NORMAL);
+}
+}
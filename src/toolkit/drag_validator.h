@@ -0,0 +1,87 @@
+#pragma once
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/HashSet.h>
+#include <Urho3D/Container/Ptr.h>
+#include <math_utils.h>
+#include <tile_footprint.h>
+
+namespace Urho3D
+{
+class Node;
+} // namespace Urho3D
+
+class Hex_Tile_Grid;
+class Tile_Occupier;
+
+namespace bbtk
+{
+class Selector;
+
+/*!
+Checks whether the selection can be dropped where it currently is. The selection's node ids are snapshotted when
+begin is called and excluded from every grid query, so the selection never collides with itself and nothing has to
+be removed from the grid while dragging. Each update only re-tests the nodes whose origin cell or footprint changed
+since the last update - a drag which has not crossed a cell boundary costs a position compare per node.
+
+Cells outside the selection can change during the drag too. The grid chunk revisions are compared each update, and
+the bumps the selection's own moves account for are taken off. Nodes tested against a chunk that changed for any
+other reason are re-tested. Call clear when the selection changes or a new drag starts so the next begin takes a
+fresh snapshot.
+
+Blocked nodes have their Selector switched to the blocked outline as they are found, and back when they come free.
+*/
+class Drag_Validator
+{
+  public:
+    Drag_Validator();
+
+    void begin(Hex_Tile_Grid * grid, const Urho3D::HashSet<Urho3D::Node *> & selection);
+
+    void clear();
+
+    bool active() const;
+
+    // Re-test the nodes that moved - returns true if any node changed between blocked and free
+    bool update();
+
+    // Number of selected nodes currently overlapping something outside the selection
+    uint32_t blocked_count() const;
+
+  private:
+    struct Drag_Entry
+    {
+        Urho3D::WeakPtr<Urho3D::Node> node_;
+        Urho3D::WeakPtr<Tile_Occupier> occ_;
+        Urho3D::WeakPtr<Selector> selector_;
+        // Footprint and origin cell the entry was last tested with
+        Urho3D::SharedPtr<Tile_Footprint> footprint_;
+        ivec3 cell_;
+        bool tested_;
+        bool blocked_;
+    };
+
+    bool _test(Tile_Footprint * footprint, const ivec3 & cell) const;
+
+    // Chunks whose revision changed since the last update for reasons other than the selection's own moves
+    void _outside_changes(const Urho3D::HashMap<ivec3, uint32_t> & revs, Urho3D::HashSet<ivec3> & out) const;
+
+    // Whether any of footprint's cells at cell are in one of chunks
+    static bool _touches(Tile_Footprint * footprint, const ivec3 & cell, const Urho3D::HashSet<ivec3> & chunks);
+
+    void _set_blocked(Drag_Entry & entry, bool blocked);
+
+    Hex_Tile_Grid * grid_;
+
+    Urho3D::Vector<Drag_Entry> entries_;
+
+    Urho3D::HashSet<int> excluded_ids_;
+
+    // Grid chunk revisions and grid revision as of the last update
+    Urho3D::HashMap<ivec3, uint32_t> chunk_revs_;
+
+    uint32_t grid_revision_;
+
+    uint32_t blocked_count_;
+};
+}
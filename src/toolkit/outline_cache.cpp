@@ -0,0 +1,102 @@
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/Technique.h>
+
+#include "outline_cache.h"
+#include "selector.h"
+
+using namespace Urho3D;
+
+namespace
+{
+const Urho3D::String OUTLINE_PASS = "outline";
+}
+
+namespace bbtk
+{
+
+Outline_Cache::Outline_Cache(Urho3D::Context * context) : Object(context)
+{}
+
+Outline_Cache::~Outline_Cache()
+{}
+
+Urho3D::Material * Outline_Cache::material(Urho3D::Material * base, int state)
+{
+    if (base == nullptr)
+        return nullptr;
+
+    auto iter = materials_.Find(MakePair(base, state));
+    if (iter != materials_.End() && iter->second_.base_ == base)
+        return iter->second_.variant_;
+
+    _prune();
+
+    Material_Entry & entry = materials_[MakePair(base, state)];
+    entry.base_ = base;
+    entry.state_ = state;
+    entry.variant_ = base->Clone(base->GetName() + (state == Selector::OUTLINE_BLOCKED ? "_blocked" : "_outline"));
+    for (uint32_t i = 0; i < entry.variant_->GetNumTechniques(); ++i)
+    {
+        const TechniqueEntry & te = entry.variant_->GetTechniqueEntry(i);
+        entry.variant_->SetTechnique(i, _technique(te.technique_), te.qualityLevel_, te.lodDistance_);
+    }
+    entry.variant_->SetShaderParameter("OutlineEnable", true);
+    entry.variant_->SetShaderParameter(
+        "OutlineColor", (state == Selector::OUTLINE_BLOCKED) ? SEL_OUTLINE_BLOCKED_COL : SEL_OUTLINE_COL);
+    variants_.Insert(entry.variant_);
+    return entry.variant_;
+}
+
+bool Outline_Cache::is_variant(Urho3D::Material * mat) const
+{
+    return mat != nullptr && variants_.Contains(mat);
+}
+
+Urho3D::Technique * Outline_Cache::_technique(Urho3D::Technique * base)
+{
+    if (base == nullptr || base->HasPass(OUTLINE_PASS))
+        return base;
+
+    Technique_Entry & entry = techniques_[base];
+    if (entry.variant_ != nullptr && entry.base_ == base)
+        return entry.variant_;
+
+    // Same as the base technique plus the mask pass the outline render path picks up
+    entry.base_ = base;
+    entry.variant_ = base->Clone(base->GetName() + "_outline");
+    Pass * pass = entry.variant_->CreatePass(OUTLINE_PASS);
+    pass->SetVertexShader("Outline");
+    pass->SetPixelShader("Outline");
+    pass->SetPixelShaderDefines("MASK");
+    pass->SetDepthTestMode(CMP_ALWAYS);
+    pass->SetDepthWrite(false);
+    return entry.variant_;
+}
+
+void Outline_Cache::_prune()
+{
+    auto mat_iter = materials_.Begin();
+    while (mat_iter != materials_.End())
+    {
+        if (mat_iter->second_.base_.Expired())
+        {
+            variants_.Erase(mat_iter->second_.variant_);
+            mat_iter = materials_.Erase(mat_iter);
+        }
+        else
+        {
+            ++mat_iter;
+        }
+    }
+
+    auto tech_iter = techniques_.Begin();
+    while (tech_iter != techniques_.End())
+    {
+        if (tech_iter->second_.base_.Expired())
+            tech_iter = techniques_.Erase(tech_iter);
+        else
+            ++tech_iter;
+    }
+}
+
+} // namespace bbtk
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Container/HashSet.h>
+
+namespace Urho3D
+{
+class Material;
+class Technique;
+} // namespace Urho3D
+
+namespace bbtk
+{
+
+/*!
+Subsystem holding the outline variants the Selector swaps in - one cloned material per base material and outline
+state, and one cloned technique (with the outline mask pass added) per base technique. Owned by the Context so the
+clones are released while it is still alive. Entries whose base resource has been freed are dropped whenever a new
+variant is made.
+*/
+class Outline_Cache : public Urho3D::Object
+{
+    URHO3D_OBJECT(Outline_Cache, Urho3D::Object);
+
+  public:
+    Outline_Cache(Urho3D::Context * context);
+    ~Outline_Cache();
+
+    // The shared variant of base for state (one of Selector::Outline_State), made the first time it is asked for
+    Urho3D::Material * material(Urho3D::Material * base, int state);
+
+    // Whether mat is one of the variants handed out by material
+    bool is_variant(Urho3D::Material * mat) const;
+
+  private:
+    struct Material_Entry
+    {
+        Urho3D::WeakPtr<Urho3D::Material> base_;
+        Urho3D::SharedPtr<Urho3D::Material> variant_;
+        int state_;
+    };
+
+    struct Technique_Entry
+    {
+        Urho3D::WeakPtr<Urho3D::Technique> base_;
+        Urho3D::SharedPtr<Urho3D::Technique> variant_;
+    };
+
+    Urho3D::Technique * _technique(Urho3D::Technique * base);
+
+    void _prune();
+
+    // Keyed by base pointer and state - the weak pointer catches a new resource allocated where a freed one used to be
+    Urho3D::HashMap<Urho3D::Pair<Urho3D::Material *, int>, Material_Entry> materials_;
+
+    Urho3D::HashMap<Urho3D::Technique *, Technique_Entry> techniques_;
+
+    Urho3D::HashSet<Urho3D::Material *> variants_;
+};
+
+} // namespace bbtk
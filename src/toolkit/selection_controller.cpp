@@ -9,9 +9,14 @@
 #include <Urho3D/Graphics/View.h>
 #include <Urho3D/Graphics/DebugRenderer.h>
 #include <Urho3D/Graphics/StaticModelGroup.h>
+#include <Urho3D/Graphics/CustomGeometry.h>
 
 #include <Urho3D/Resource/ResourceCache.h>
 
+#include <Urho3D/Core/WorkQueue.h>
+
+#include <Urho3D/Input/Input.h>
+
 #include "selection_controller.h"
 #include "selector.h"
 
@@ -19,6 +24,8 @@
 #include <mtdebug_print.h>
 #include <hex_tile_grid.h>
 #include <tile_occupier.h>
+#include <tile_save_scope.h>
+#include <chunk_mesh_baker.h>
 #include <string>
 
 #include <urho_common.h>
@@ -32,7 +39,21 @@ namespace bbtk
           selection_rect_(-1.0f, -1.0f, -1.0f, -1.0f),
           movement_flag_(0),
           move_allowed_(true),
-          do_snap_(false)
+          do_snap_(false),
+          sel_generation_(0),
+          sel_backend_(SEL_BACKEND_GRID),
+          occ_buffer_built_(false),
+          last_pick_grid_rev_(0),
+          last_pick_precise_(false),
+          last_pick_valid_(false),
+          hover_enabled_(true),
+          hover_mpos_(-1.0f, -1.0f),
+          sel_mode_(SEL_MODE_RECT),
+          brush_radius_(SEL_DEFAULT_BRUSH_RADIUS),
+          stroke_active_(false),
+          has_last_brush_cell_(false),
+          clipboard_count_(0),
+          clipboard_height_(0)
     {
         hashes_.Push(StringHash(SEL_OBJ_NAME));
         hashes_.Push(StringHash(DRAG_SELECTED_OBJECT));
@@ -43,6 +64,12 @@ namespace bbtk
         hashes_.Push(StringHash(X_MOVE_HELD));
         hashes_.Push(StringHash(Y_MOVE_HELD));
         hashes_.Push(StringHash(TOGGLE_OCC_DEBUG));
+        hashes_.Push(StringHash(ROTATE_SELECTION));
+        hashes_.Push(StringHash(HOVER_OBJECT));
+        hashes_.Push(StringHash(COPY_SELECTION));
+        hashes_.Push(StringHash(PASTE_SELECTION));
+        hashes_.Push(StringHash(DUPLICATE_SELECTION));
+        hashes_.Push(StringHash(CYCLE_SELECTION_MODE));
 
         SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(Selection_Controller, handle_update));
         SubscribeToEvent(E_INPUT_TRIGGER,
@@ -51,6 +78,10 @@ namespace bbtk
                          URHO3D_HANDLER(Selection_Controller, handle_component_added));
         SubscribeToEvent(E_COMPONENTREMOVED,
                          URHO3D_HANDLER(Selection_Controller, handle_component_removed));
+        SubscribeToEvent(E_NODETAGADDED,
+                         URHO3D_HANDLER(Selection_Controller, handle_node_tag_changed));
+        SubscribeToEvent(E_NODETAGREMOVED,
+                         URHO3D_HANDLER(Selection_Controller, handle_node_tag_changed));
     }
 
     void Selection_Controller::create_selection_rect(Urho3D::UIElement *containing)
@@ -113,13 +144,91 @@ namespace bbtk
     void Selection_Controller::OnSceneSet(Scene *scene)
     {
         scene_ = scene;
+        attr_index_.clear();
         Component::OnSceneSet(scene_);
     }
 
     void Selection_Controller::clear_selection()
     {
+        HashSet<Node *> prev_sel(selection_);
+        HashSet<Node *> prev_rect_sel(sel_rect_selection_);
         selection_.Clear();
         sel_rect_selection_.Clear();
+
+        auto iter = prev_sel.Begin();
+        while (iter != prev_sel.End())
+        {
+            _record_removed(*iter);
+            _refresh_selector(*iter);
+            ++iter;
+        }
+
+        iter = prev_rect_sel.Begin();
+        while (iter != prev_rect_sel.End())
+        {
+            _refresh_selector(*iter);
+            ++iter;
+        }
+    }
+
+    void Selection_Controller::_refresh_selector(Node *node)
+    {
+        Selector *es = node->GetComponent<Selector>();
+        if (es != nullptr)
+            es->set_selected(is_selected(node));
+    }
+
+    void Selection_Controller::_record_added(Node *node)
+    {
+        if (!sel_removed_.Erase(node))
+            sel_added_.Insert(node);
+    }
+
+    void Selection_Controller::_record_removed(Node *node)
+    {
+        if (!sel_added_.Erase(node))
+            sel_removed_.Insert(node);
+    }
+
+    void Selection_Controller::_send_selection_changed()
+    {
+        if (sel_added_.Empty() && sel_removed_.Empty())
+            return;
+
+        VariantVector added;
+        added.Reserve(sel_added_.Size());
+        auto iter = sel_added_.Begin();
+        while (iter != sel_added_.End())
+        {
+            added.Push(static_cast<void *>(*iter));
+            ++iter;
+        }
+
+        VariantVector removed;
+        removed.Reserve(sel_removed_.Size());
+        iter = sel_removed_.Begin();
+        while (iter != sel_removed_.End())
+        {
+            removed.Push(static_cast<void *>(*iter));
+            ++iter;
+        }
+
+        sel_added_.Clear();
+        sel_removed_.Clear();
+        ++sel_generation_;
+        drag_validator_.clear();
+
+        using namespace SelectionChanged;
+        VariantMap &event_data = GetEventDataMap();
+        event_data[P_ADDED] = added;
+        event_data[P_REMOVED] = removed;
+        event_data[P_GENERATION] = sel_generation_;
+        SendEvent(E_SELECTION_CHANGED, event_data);
+    }
+
+    uint32_t Selection_Controller::selection_generation() const
+    {
+        return sel_generation_;
     }
 
     void Selection_Controller::handle_component_added(StringHash event_type,
@@ -130,7 +239,20 @@ namespace bbtk
             return;
         Component *comp = static_cast<Component *>(event_data[ComponentRemoved::P_COMPONENT].GetPtr());
         if (comp->IsInstanceOf<Selector>())
-            scene_sel_comps_.Insert(static_cast<Selector *>(comp));
+        {
+            Selector *escomp = static_cast<Selector *>(comp);
+            scene_sel_comps_.Insert(escomp);
+            escomp->set_selected(is_selected(escomp->GetNode()));
+            attr_index_.add(comp->GetNode());
+        }
+        else if (comp->IsInstanceOf<Tile_Occupier>())
+        {
+            attr_index_.add(comp->GetNode());
+        }
+        else if (comp->IsInstanceOf<StaticModel>())
+        {
+            attr_index_.mark_dirty(comp->GetNode());
+        }
     }
 
     void Selection_Controller::handle_component_removed(StringHash event_type,
@@ -144,13 +266,34 @@ namespace bbtk
         {
             Selector *escomp = static_cast<Selector *>(comp);
             escomp->set_selected(false);
-            selection_.Erase(escomp->GetNode());
+            if (selection_.Erase(escomp->GetNode()))
+                _record_removed(escomp->GetNode());
+            sel_rect_selection_.Erase(escomp->GetNode());
             scene_sel_comps_.Erase(escomp);
+            if (!comp->GetNode()->HasComponent<Tile_Occupier>())
+                attr_index_.remove(comp->GetNode());
+        }
+        else if (comp->IsInstanceOf<Tile_Occupier>())
+        {
+            if (!comp->GetNode()->HasComponent<Selector>())
+                attr_index_.remove(comp->GetNode());
         }
         else if (comp->IsInstanceOf<StaticModel>() && comp->GetNode()->HasComponent<Selector>())
         {
             comp->GetNode()->RemoveComponent<Selector>();
         }
+        else if (comp->IsInstanceOf<StaticModel>())
+        {
+            attr_index_.mark_dirty(comp->GetNode());
+        }
+    }
+
+    void Selection_Controller::handle_node_tag_changed(StringHash event_type, VariantMap &event_data)
+    {
+        Scene *scn = static_cast<Scene *>(event_data[NodeTagAdded::P_SCENE].GetPtr());
+        if (scene_ != scn)
+            return;
+        attr_index_.mark_dirty(static_cast<Node *>(event_data[NodeTagAdded::P_NODE].GetPtr()));
     }
 
     void Selection_Controller::DrawDebugGeometry(bool depth_test)
@@ -175,27 +318,374 @@ namespace bbtk
 
     void Selection_Controller::translate_selection(const fvec3 &translation)
     {
+        PODVector<Node *> nodes;
+        nodes.Reserve(selection_.Size());
         auto sel_iter = selection_.Begin();
         while (sel_iter != selection_.End())
         {
-            (*sel_iter)->Translate(translation, TS_WORLD);
+            nodes.Push(*sel_iter);
             ++sel_iter;
         }
+        transform_nodes(nodes, SEL_XFORM_TRANSLATE, translation);
+    }
+
+    void Selection_Controller::transform_nodes(const PODVector<Node *> &nodes,
+                                               Selection_Transform op,
+                                               const fvec3 &param)
+    {
+        if (nodes.Empty())
+            return;
+
+        // Reading the world position can update the node's cached transform so it has to happen on this thread
+        PODVector<fvec3> src(nodes.Size());
+        PODVector<fvec3> dst(nodes.Size());
+        for (uint32_t i = 0; i < nodes.Size(); ++i)
+            src[i] = nodes[i]->GetWorldPosition();
+
+        WorkQueue *queue = GetSubsystem<WorkQueue>();
+        if (queue == nullptr || queue->GetNumThreads() == 0 || nodes.Size() < SEL_XFORM_PARALLEL_MIN)
+        {
+            Transform_Job job = {src.Buffer(), dst.Buffer(), src.Size(), op, param};
+            _transform_positions(job);
+        }
+        else
+        {
+            // One slice per worker plus one for the main thread, which helps out in Complete
+            uint32_t slice_count = queue->GetNumThreads() + 1;
+            uint32_t slice_size = (src.Size() + slice_count - 1) / slice_count;
+            PODVector<Transform_Job> jobs;
+            jobs.Reserve(slice_count);
+            for (uint32_t begin = 0; begin < src.Size(); begin += slice_size)
+            {
+                uint32_t count = Min(slice_size, src.Size() - begin);
+                Transform_Job job = {src.Buffer() + begin, dst.Buffer() + begin, count, op, param};
+                jobs.Push(job);
+            }
+
+            for (uint32_t i = 0; i < jobs.Size(); ++i)
+            {
+                SharedPtr<WorkItem> item = queue->GetFreeItem();
+                item->workFunction_ = _run_transform_job;
+                item->aux_ = &jobs[i];
+                item->priority_ = M_MAX_UNSIGNED;
+                queue->AddWorkItem(item);
+            }
+            queue->Complete(M_MAX_UNSIGNED);
+        }
+
+        // Occupiers ignore their nodes' dirty notifications while the positions are set - the grid gets every moved
+        // occupier at once at the end
+        Hex_Tile_Grid *tg = scene_->GetComponent<Hex_Tile_Grid>();
+        bool was_suppressed = (tg != nullptr) && tg->moves_suppressed();
+        if (tg != nullptr)
+            tg->set_moves_suppressed(true);
+
+        PODVector<Tile_Occupier *> moved_occs;
+        PODVector<Tile_Occupier *> node_occs;
+        for (uint32_t i = 0; i < nodes.Size(); ++i)
+        {
+            if (dst[i] == src[i])
+                continue;
+
+            nodes[i]->SetWorldPosition(dst[i]);
+            if (tg != nullptr)
+            {
+                nodes[i]->GetComponents<Tile_Occupier>(node_occs, true);
+                moved_occs.Push(node_occs);
+            }
+        }
+
+        if (tg != nullptr)
+        {
+            tg->set_moves_suppressed(was_suppressed);
+            tg->occupiers_moved(moved_occs);
+        }
+    }
+
+    void Selection_Controller::_run_transform_job(const WorkItem *item, uint32_t thread_index)
+    {
+        _transform_positions(*static_cast<const Transform_Job *>(item->aux_));
+    }
+
+    void Selection_Controller::_transform_positions(const Transform_Job &job)
+    {
+        switch (job.op_)
+        {
+        case (SEL_XFORM_TRANSLATE):
+            for (uint32_t i = 0; i < job.count_; ++i)
+                job.dst_[i] = job.src_[i] + job.param_;
+            break;
+        case (SEL_XFORM_SNAP):
+            for (uint32_t i = 0; i < job.count_; ++i)
+            {
+                job.dst_[i] = job.src_[i];
+                Hex_Tile_Grid::snap_to_grid(job.dst_[i]);
+            }
+            break;
+        }
+    }
+
+    /*!
+    Rotate the selection by steps * 60 degrees about z around the grid cell nearest its centre. Each node is moved to
+    its rotated cell and turned in place - the occupiers pick up their cached rotated footprints from the node rotation.
+    Selected nodes under a selected ancestor are carried by it. If any rotated footprint lands on something outside
+    the selection the rotation is undone.
+    */
+    void Selection_Controller::rotate_selection(int steps)
+    {
+        PODVector<Node *> nodes;
+        nodes.Reserve(selection_.Size());
+        auto sel_iter = selection_.Begin();
+        while (sel_iter != selection_.End())
+        {
+            Node *nd = *sel_iter;
+            ++sel_iter;
+
+            bool ancestor_selected = false;
+            for (Node *parent = nd->GetParent(); parent != nullptr && !ancestor_selected; parent = parent->GetParent())
+                ancestor_selected = selection_.Contains(parent);
+            if (!ancestor_selected)
+                nodes.Push(nd);
+        }
+        if (nodes.Empty())
+            return;
+
+        fvec3 center;
+        for (uint32_t i = 0; i < nodes.Size(); ++i)
+            center += nodes[i]->GetWorldPosition();
+        center /= float(nodes.Size());
+        ivec3 pivot = Hex_Tile_Grid::world_to_grid(center);
+
+        fquat rot(steps * 360.0f / FOOTPRINT_ROTATION_STEPS, fvec3::FORWARD);
+        PODVector<fvec3> old_positions(nodes.Size());
+        PODVector<fquat> old_rotations(nodes.Size());
+        PODVector<fvec3> positions(nodes.Size());
+        PODVector<fquat> rotations(nodes.Size());
+        for (uint32_t i = 0; i < nodes.Size(); ++i)
+        {
+            old_positions[i] = nodes[i]->GetWorldPosition();
+            old_rotations[i] = nodes[i]->GetWorldRotation();
+            ivec3 cell = Hex_Tile_Grid::rotate_cell(Hex_Tile_Grid::world_to_grid(old_positions[i]), steps, pivot);
+            positions[i] = Hex_Tile_Grid::grid_to_world(cell);
+            rotations[i] = rot * old_rotations[i];
+        }
+        _set_world_transforms(nodes, positions, rotations);
+
+        Hex_Tile_Grid *tg = scene_->GetComponent<Hex_Tile_Grid>();
+        if (tg == nullptr)
+            return;
+
+        // The rotated footprints are swapped in when the grid updates the occupiers, which may have been deferred
+        tg->flush_updates();
+        drag_validator_.begin(tg, selection_);
+        drag_validator_.update();
+        if (drag_validator_.blocked_count() > 0)
+            _set_world_transforms(nodes, old_positions, old_rotations);
+        drag_validator_.clear();
+    }
+
+    void Selection_Controller::_set_world_transforms(const PODVector<Node *> &nodes,
+                                                     const PODVector<fvec3> &positions,
+                                                     const PODVector<fquat> &rotations)
+    {
+        Hex_Tile_Grid *tg = scene_->GetComponent<Hex_Tile_Grid>();
+        bool was_suppressed = (tg != nullptr) && tg->moves_suppressed();
+        if (tg != nullptr)
+            tg->set_moves_suppressed(true);
+
+        PODVector<Tile_Occupier *> moved_occs;
+        PODVector<Tile_Occupier *> node_occs;
+        for (uint32_t i = 0; i < nodes.Size(); ++i)
+        {
+            // One dirty notification per node for both the position and the rotation
+            nodes[i]->SetWorldTransform(positions[i], rotations[i]);
+            if (tg != nullptr)
+            {
+                nodes[i]->GetComponents<Tile_Occupier>(node_occs, true);
+                moved_occs.Push(node_occs);
+            }
+        }
+
+        if (tg != nullptr)
+        {
+            tg->set_moves_suppressed(was_suppressed);
+            tg->occupiers_moved(moved_occs);
+        }
     }
 
     void Selection_Controller::delete_selection()
     {
+        if (selection_.Empty())
+            return;
+
+        // Hold references so a selected child is still alive when its selected parent has already been removed
+        Vector<SharedPtr<Node>> doomed;
+        doomed.Reserve(selection_.Size());
+        PODVector<Tile_Occupier *> occs;
+        PODVector<Tile_Occupier *> node_occs;
+        PODVector<Selector *> node_sels;
+
         auto sel_iter = selection_.Begin();
         while (sel_iter != selection_.End())
         {
-            (*sel_iter)->RemoveAllComponents();
-            (*sel_iter)->Remove();
+            Node *nd = *sel_iter;
+            doomed.Push(SharedPtr<Node>(nd));
+            _record_removed(nd);
+
+            nd->GetComponents<Tile_Occupier>(node_occs, true);
+            occs.Push(node_occs);
+            for (uint32_t i = 0; i < node_occs.Size(); ++i)
+                attr_index_.remove(node_occs[i]->GetNode());
+
+            nd->GetComponents<Selector>(node_sels, true);
+            for (uint32_t i = 0; i < node_sels.Size(); ++i)
+            {
+                scene_sel_comps_.Erase(node_sels[i]);
+                sel_rect_selection_.Erase(node_sels[i]->GetNode());
+                attr_index_.remove(node_sels[i]->GetNode());
+            }
             ++sel_iter;
         }
         selection_.Clear();
+
+        // Take every footprint out of the grid in one go, then remove the nodes without removing their components
+        // first - the scene does not send E_COMPONENTREMOVED for components of a removed node, so neither the grid
+        // nor this controller handle them one at a time
+        Hex_Tile_Grid *tg = scene_->GetComponent<Hex_Tile_Grid>();
+        if (tg != nullptr)
+            tg->unregister_occupiers(occs);
+
+        for (uint32_t i = 0; i < doomed.Size(); ++i)
+            doomed[i]->Remove();
         //bbtk.ui->graph->rebuild();
     }
 
+    void Selection_Controller::copy_selection()
+    {
+        clipboard_.Clear();
+        clipboard_count_ = 0;
+        if (selection_.Empty())
+            return;
+
+        // Outline variants are clones the resource cache does not know - save the real materials instead
+        auto sel_iter = selection_.Begin();
+        while (sel_iter != selection_.End())
+        {
+            Selector *sel = (*sel_iter)->GetComponent<Selector>();
+            if (sel != nullptr)
+                sel->suspend_outline();
+            ++sel_iter;
+        }
+
+        ivec3 min_cell(M_MAX_INT, M_MAX_INT, M_MAX_INT);
+        ivec3 max_cell(M_MIN_INT, M_MIN_INT, M_MIN_INT);
+        sel_iter = selection_.Begin();
+        while (sel_iter != selection_.End())
+        {
+            Node *nd = *sel_iter;
+            ++sel_iter;
+
+            // Selected children are saved along with their selected ancestor
+            bool ancestor_selected = false;
+            for (Node *parent = nd->GetParent(); parent != nullptr && !ancestor_selected; parent = parent->GetParent())
+                ancestor_selected = selection_.Contains(parent);
+            if (ancestor_selected)
+                continue;
+
+            fvec3 pos = nd->GetWorldPosition();
+            clipboard_.WriteVector3(pos);
+            clipboard_.WriteQuaternion(nd->GetWorldRotation());
+            {
+                // Batched, baked or buried tiles under the node must not be saved with their models disabled
+                Tile_Save_Scope save_scope(nd);
+                nd->Save(clipboard_);
+            }
+            ++clipboard_count_;
+
+            ivec3 cell = Hex_Tile_Grid::world_to_grid(pos);
+            min_cell = ivec3(Min(min_cell.x_, cell.x_), Min(min_cell.y_, cell.y_), Min(min_cell.z_, cell.z_));
+            max_cell = ivec3(Max(max_cell.x_, cell.x_), Max(max_cell.y_, cell.y_), Max(max_cell.z_, cell.z_));
+        }
+
+        sel_iter = selection_.Begin();
+        while (sel_iter != selection_.End())
+        {
+            Selector *sel = (*sel_iter)->GetComponent<Selector>();
+            if (sel != nullptr)
+                sel->resume_outline();
+            ++sel_iter;
+        }
+
+        clipboard_anchor_ = ivec3((min_cell.x_ + max_cell.x_) / 2, (min_cell.y_ + max_cell.y_) / 2, min_cell.z_);
+        clipboard_height_ = max_cell.z_ - min_cell.z_ + 1;
+    }
+
+    void Selection_Controller::paste_clipboard(const ivec3 &anchor_cell)
+    {
+        if (clipboard_count_ == 0)
+            return;
+
+        // Shift in axial coords so odd and even rows stay lined up the way they were copied
+        ivec3 axial_shift =
+            Hex_Tile_Grid::offset_to_axial(anchor_cell) - Hex_Tile_Grid::offset_to_axial(clipboard_anchor_);
+
+        Hex_Tile_Grid *tg = scene_->GetComponent<Hex_Tile_Grid>();
+        if (tg != nullptr)
+            tg->begin_batch();
+
+        clear_selection();
+        clipboard_.Seek(0);
+        for (uint32_t i = 0; i < clipboard_count_; ++i)
+        {
+            fvec3 pos = clipboard_.ReadVector3();
+            fquat rot = clipboard_.ReadQuaternion();
+
+            ivec3 cell = Hex_Tile_Grid::world_to_grid(pos);
+            ivec3 new_cell = Hex_Tile_Grid::axial_to_offset(Hex_Tile_Grid::offset_to_axial(cell) + axial_shift);
+            fvec3 new_pos = Hex_Tile_Grid::grid_to_world(new_cell) + (pos - Hex_Tile_Grid::grid_to_world(cell));
+
+            Node *nd = scene_->Instantiate(clipboard_, new_pos, rot, REPLICATED);
+            if (nd == nullptr)
+            {
+                // The rest of the stream can not be trusted after a failed load
+                wout << "Paste stopped after" << i << "of" << clipboard_count_ << "nodes - could not instantiate node";
+                break;
+            }
+            add_to_selection(nd);
+        }
+
+        if (tg != nullptr)
+            tg->end_batch();
+    }
+
+    void Selection_Controller::paste_at_cursor()
+    {
+        if (clipboard_count_ == 0)
+            return;
+
+        ivec3 anchor_cell = clipboard_anchor_;
+        if (hover_mpos_.x_ >= 0.0f && cam_comp_ != nullptr && ui_container_ != nullptr)
+        {
+            const PODVector<RayQueryResult> &res = _pick(hover_mpos_, true);
+
+            // The cell on the hit side of the surface
+            if (!res.Empty())
+                anchor_cell = Hex_Tile_Grid::world_to_grid(res[0].position_ + res[0].normal_ * (0.5f * Z_GRID));
+        }
+        paste_clipboard(anchor_cell);
+    }
+
+    void Selection_Controller::duplicate_selection()
+    {
+        copy_selection();
+        paste_clipboard(clipboard_anchor_ + ivec3(0, 0, clipboard_height_));
+    }
+
+    bool Selection_Controller::clipboard_empty() const
+    {
+        return clipboard_count_ == 0;
+    }
+
     void Selection_Controller::toggle_occ_debug_selection()
     {
         auto sel_iter = selection_.Begin();
@@ -216,6 +706,8 @@ namespace bbtk
             if (*iter == node)
             {
                 selection_.Erase(iter);
+                _record_removed(node);
+                _refresh_selector(node);
                 return;
             }
             ++iter;
@@ -235,62 +727,16 @@ namespace bbtk
     void Selection_Controller::handle_update(StringHash event_type,
                                              VariantMap &event_data)
     {
-        ResourceCache *cache = GetSubsystem<ResourceCache>();
-        static HashMap<Material *, bool> mat_map;
-        Vector<Hex_Tile_Grid::Tile_Item> allowed_items;
-
-        static VariantVector sel_vec;
-        static VariantVector prev_sel_vec;
-        prev_sel_vec = sel_vec;
-
-        allowed_items.Resize(selection_.Size());
-        sel_vec.Resize(selection_.Size());
-
-        int i = 0;
-        auto sel_iter_al = selection_.Begin();
-        while (sel_iter_al != selection_.End())
-        {
-            int node_id = (*sel_iter_al)->GetID();
-            allowed_items[i].node_id_ = node_id;
-            sel_vec[i] = static_cast<void *>(*sel_iter_al);
-            ++i;
-            ++sel_iter_al;
-        }
-
-        if (prev_sel_vec != sel_vec)
-        {
-            VariantMap event_data;
-            using namespace SelectionChanged;
-            event_data[P_PREV_SELECTION] = prev_sel_vec;
-            event_data[P_CUR_SELECTION] = sel_vec;
-            SendEvent(E_SELECTION_CHANGED, event_data);
-        }
+        _send_selection_changed();
 
         //bbtk.ui->details->set_selected_data(sel_vec, Node::GetTypeStatic());
 
+        if (frame_translation_ != fvec3())
+            translate_selection(frame_translation_);
+
         auto iter = selection_.Begin();
         while (iter != selection_.End())
         {
-            Selector *es = (*iter)->GetComponent<Selector>();
-            if (es != nullptr)
-            {
-                Material *mat = es->GetMaterial();
-                auto fiter = mat_map.Find(mat);
-                if (fiter == mat_map.End())
-                    mat_map[mat] = true;
-
-                Hex_Tile_Grid *tg = scene_->GetComponent<Hex_Tile_Grid>();
-                Tile_Occupier *occ = (*iter)->GetComponent<Tile_Occupier>();
-                if (occ != nullptr && occ->IsEnabled())
-                {
-                    auto occ_tiles =
-                        tg->occupied(occ->tile_spaces(), (*iter)->GetPosition(), allowed_items);
-                    mat_map[mat] = mat_map[mat] && occ_tiles.Empty();
-                }
-            }
-
-            (*iter)->Translate(frame_translation_, TS_WORLD);
-
             // If a node that has a light component attached is selected, draw the light debug geometry
             Light *lcomp = (*iter)->GetComponent<Light>();
             if (lcomp != nullptr)
@@ -310,48 +756,39 @@ namespace bbtk
             do_snap_ = false;
         }
 
-        auto mat_iter = mat_map.Begin();
-        while (mat_iter != mat_map.End())
-        {
-            move_allowed_ = true;
-            fvec4 color(0.0f, 0.0f, 1.0f, 1.0f);
-            if (!mat_iter->second_)
-            {
-                move_allowed_ = false;
-                color = fvec4(1.0f, 0.0f, 0.0f, 1.0f);
-                mat_iter->second_ = true;
-            }
+        _update_hover();
 
-            mat_iter->first_->SetShaderParameter("OutlineColor", color);
-            ++mat_iter;
-        }
+        // The stroke can be released with any qualifier held, so no single trigger is guaranteed to end it
+        if (stroke_active_ && !GetSubsystem<Input>()->GetMouseButtonDown(MOUSEB_LEFT))
+            _end_stroke();
+        _draw_lasso();
 
-        auto sel_comp_iter = scene_sel_comps_.Begin();
-        while (sel_comp_iter != scene_sel_comps_.End())
-        {
-            (*sel_comp_iter)->set_selected(is_selected((*sel_comp_iter)->GetNode()));
-            ++sel_comp_iter;
-        }
+        // Only the nodes that crossed a cell boundary or sit in a chunk something else changed are re-tested - the
+        // validator switches the outline of each node that changes between blocked and free
+        if (!drag_validator_.active())
+            drag_validator_.begin(scene_->GetComponent<Hex_Tile_Grid>(), selection_);
+        drag_validator_.update();
+        move_allowed_ = (drag_validator_.blocked_count() == 0);
     }
 
     void Selection_Controller::snap_selection()
     {
+        PODVector<Node *> nodes;
+        nodes.Reserve(selection_.Size() + sel_rect_selection_.Size());
         auto sel_iter = selection_.Begin();
         while (sel_iter != selection_.End())
         {
-            fvec3 pos = (*sel_iter)->GetPosition();
-            Hex_Tile_Grid::snap_to_grid(pos);
-            (*sel_iter)->SetPosition(pos);
+            nodes.Push(*sel_iter);
             ++sel_iter;
         }
         sel_iter = sel_rect_selection_.Begin();
         while (sel_iter != sel_rect_selection_.End())
         {
-            fvec3 pos = (*sel_iter)->GetPosition();
-            Hex_Tile_Grid::snap_to_grid(pos);
-            (*sel_iter)->SetPosition(pos);
+            if (!selection_.Contains(*sel_iter))
+                nodes.Push(*sel_iter);
             ++sel_iter;
         }
+        transform_nodes(nodes, SEL_XFORM_SNAP, fvec3());
     }
 
     void Selection_Controller::set_viewport(Viewport *vp)
@@ -415,6 +852,38 @@ namespace bbtk
         it.trigger_state_ = T_BEGIN;
         it.name_ = TOGGLE_OCC_DEBUG;
         ctxt->create_trigger(it);
+
+        it.condition_.key_ = KEY_R;
+        it.name_ = ROTATE_SELECTION;
+        ctxt->create_trigger(it);
+
+        it.condition_.key_ = 0;
+        it.condition_.mouse_button_ = MOUSEB_MOVE;
+        it.mb_allowed_ = MOUSEB_ANY;
+        it.qual_allowed_ = QUAL_ANY;
+        it.name_ = HOVER_OBJECT;
+        ctxt->create_trigger(it);
+
+        it.condition_.key_ = KEY_C;
+        it.condition_.mouse_button_ = 0;
+        it.mb_allowed_ = MOUSEB_ANY;
+        it.qual_required_ = QUAL_CTRL;
+        it.qual_allowed_ = 0;
+        it.name_ = COPY_SELECTION;
+        ctxt->create_trigger(it);
+
+        it.condition_.key_ = KEY_V;
+        it.name_ = PASTE_SELECTION;
+        ctxt->create_trigger(it);
+
+        it.condition_.key_ = KEY_D;
+        it.name_ = DUPLICATE_SELECTION;
+        ctxt->create_trigger(it);
+
+        it.condition_.key_ = KEY_M;
+        it.qual_required_ = 0;
+        it.name_ = CYCLE_SELECTION_MODE;
+        ctxt->create_trigger(it);
     }
 
     bool Selection_Controller::is_selected(Node *obj_node)
@@ -444,69 +913,90 @@ namespace bbtk
         fvec2 norm_sz(float(sel_sz.x_) / float(sz.x_), float(sel_sz.y_) / float(sz.y_));
         fvec2 norm_offset = norm_sel_pos + 0.5f * norm_sz - fvec2(0.5f, 0.5f);
 
-        float fov = cam_comp_->GetFov();
-        float ar = cam_comp_->GetAspectRatio();
-        float near_z = cam_comp_->GetNearClip();
-
         float new_ar = Abs(float(sel_sz.x_) / float(sel_sz.y_));
-        float new_fov = Abs(norm_sz.y_ * fov);
+        float new_fov = Abs(norm_sz.y_ * cam_comp_->GetFov());
 
         if (new_fov < 1.0f || new_ar > sz.x_ || new_ar < (1.0f / float(sz.y_)))
             return;
 
-        float ws_size_y = near_z * std::tan(radians(fov) / 2.0f);
-        float ws_size_x = ar * -ws_size_y;
-
-        fvec2 ws_sub_pos(ws_size_x * (2.0f * norm_sel_pos.x_ - 1.0f),
-                         ws_size_y * (2.0f * norm_sel_pos.y_ - 1.0f));
-        fvec2 ws_sub_sz(2.0f * norm_sz.x_ * ws_size_x, 2.0f * norm_sz.y_ * ws_size_y);
-
-        fmat4 moved_proj = perspective_from(ws_sub_pos.x_,
-                                            ws_sub_pos.x_ + ws_sub_sz.x_,
-                                            ws_sub_pos.y_ + ws_sub_sz.y_,
-                                            ws_sub_pos.y_,
-                                            near_z,
-                                            1000.0f);
-        f.Define(moved_proj * cam_comp_->GetView());
+        _sub_frustum(norm_sel_pos, norm_sz, f);
         PODVector<Drawable *> res_first;
         Octree *octree = scene_->GetComponent<Octree>();
         FrustumOctreeQuery fq(res_first, f, DRAWABLE_GEOMETRY);
         octree->GetDrawables(fq);
+        HashSet<Node *> prev_rect_sel(sel_rect_selection_);
         sel_rect_selection_.Clear();
-        for (int i = 0; i < res_first.Size(); ++i)
+        Hex_Tile_Grid *tg = scene_->GetComponent<Hex_Tile_Grid>();
+        occ_buffer_built_ = false;
+        // Batched and baked tiles come back as their group or chunk mesh - test each tile on its own with its
+        // (disabled) StaticModel
+        Chunk_Mesh_Baker *baker = scene_->GetComponent<Chunk_Mesh_Baker>();
+        PODVector<Node *> baked;
+        PODVector<Pair<Node *, Drawable *>> candidates;
+        candidates.Reserve(res_first.Size());
+        for (uint32_t i = 0; i < res_first.Size(); ++i)
+        {
+            if (res_first[i]->IsInstanceOf<StaticModelGroup>())
+            {
+                StaticModelGroup *group = static_cast<StaticModelGroup *>(res_first[i]);
+                for (uint32_t j = 0; j < group->GetNumInstanceNodes(); ++j)
+                {
+                    Node *inst = group->GetInstanceNode(j);
+                    StaticModel *inst_sm = (inst != nullptr) ? inst->GetComponent<StaticModel>() : nullptr;
+                    if (inst_sm != nullptr)
+                        candidates.Push(MakePair(inst, static_cast<Drawable *>(inst_sm)));
+                }
+            }
+            else if (baker != nullptr && res_first[i]->IsInstanceOf<CustomGeometry>())
+            {
+                baked.Clear();
+                baker->baked_nodes(res_first[i]->GetNode(), baked);
+                if (baked.Empty())
+                    candidates.Push(MakePair(res_first[i]->GetNode(), res_first[i]));
+                for (uint32_t j = 0; j < baked.Size(); ++j)
+                {
+                    StaticModel *baked_sm = baked[j]->GetComponent<StaticModel>();
+                    if (baked_sm != nullptr)
+                        candidates.Push(MakePair(baked[j], static_cast<Drawable *>(baked_sm)));
+                }
+            }
+            else
+            {
+                candidates.Push(MakePair(res_first[i]->GetNode(), res_first[i]));
+            }
+        }
+
+        for (uint32_t i = 0; i < candidates.Size(); ++i)
         {
-            Node *nd = res_first[i]->GetNode();
-            StaticModel *sm = static_cast<StaticModel *>(res_first[i]);
+            Node *nd = candidates[i].first_;
             Selector *es = nd->GetComponent<Selector>();
 
             if (es == nullptr)
                 continue;
 
-            const BoundingBox &bb = sm->GetWorldBoundingBox();
-
             bool left_drag = (norm_sel_pos.x_ < selection_rect_.z_);
 
             bool ray_success = false;
             auto fiter = cached_raycasts_.Find(nd);
 
-            // Go through all objects in frustum and check the raycast
+            // Go through all objects in frustum and check if they are frontmost
             // If dragging left, include the object no matter what (similar to autocad)
-            // Otherwise only include if it is the closest one to the camera
-            // Use OBB for these checks
+            // Otherwise only include if it is the closest one to the camera - grid occupiers are resolved with a
+            // column lookup, anything else with the occlusion buffer (or an OBB raycast for the octree backend)
             if (fiter == cached_raycasts_.End())
             {
-
-                fvec3 cam_pos = cam_comp_->GetNode()->GetWorldPosition();
-                fvec3 direction = nd->GetWorldPosition() - cam_pos;
-                direction.Normalize();
-                Ray cast_ray(cam_pos, direction);
-
-                Octree *oct = scene_->GetComponent<Octree>();
-                PODVector<RayQueryResult> res;
-                RayOctreeQuery q(res, cast_ray, RAY_OBB, M_INFINITY, DRAWABLE_GEOMETRY);
-                oct->RaycastSingle(q);
-
-                ray_success = left_drag || (res.Size() == 1 && res[0].node_ == nd);
+                if (left_drag)
+                    ray_success = true;
+                else if (sel_backend_ == SEL_BACKEND_GRID && tg != nullptr && nd->HasComponent<Tile_Occupier>())
+                    ray_success = _frontmost_in_column(tg, nd);
+                else if (sel_backend_ == SEL_BACKEND_OCTREE)
+                    ray_success = _frontmost_by_raycast(nd);
+                else
+                {
+                    if (!occ_buffer_built_)
+                        _build_occlusion(res_first);
+                    ray_success = _frontmost_by_occlusion(candidates[i].second_);
+                }
                 cached_raycasts_[nd] = ray_success;
             }
             else
@@ -517,8 +1007,479 @@ namespace bbtk
             if (ray_success)
             {
                 sel_rect_selection_.Insert(nd);
+                if (!prev_rect_sel.Erase(nd))
+                    _refresh_selector(nd);
             }
         }
+
+        // Whatever is left dropped out of the rect this frame
+        auto iter = prev_rect_sel.Begin();
+        while (iter != prev_rect_sel.End())
+        {
+            _refresh_selector(*iter);
+            ++iter;
+        }
+    }
+
+    bool Selection_Controller::_frontmost_by_raycast(Node *nd)
+    {
+        fvec3 cam_pos = cam_comp_->GetNode()->GetWorldPosition();
+        fvec3 direction = nd->GetWorldPosition() - cam_pos;
+        direction.Normalize();
+        Ray cast_ray(cam_pos, direction);
+
+        Octree *oct = scene_->GetComponent<Octree>();
+        PODVector<RayQueryResult> res;
+        RayOctreeQuery q(res, cast_ray, RAY_OBB, M_INFINITY, DRAWABLE_GEOMETRY);
+        oct->RaycastSingle(q);
+
+        return (res.Size() == 1 && _hit_node(res[0]) == nd);
+    }
+
+    Node *Selection_Controller::_hit_node(const RayQueryResult &res)
+    {
+        if (res.drawable_ != nullptr && res.drawable_->IsInstanceOf<StaticModelGroup>())
+            return static_cast<StaticModelGroup *>(res.drawable_)->GetInstanceNode(res.subObject_);
+
+        // Baked terrain hits the chunk mesh - the tile is found from the grid cell behind the face
+        if (res.drawable_ != nullptr && res.drawable_->IsInstanceOf<CustomGeometry>() && res.node_ != nullptr)
+        {
+            Scene *scn = res.node_->GetScene();
+            Chunk_Mesh_Baker *baker = (scn != nullptr) ? scn->GetComponent<Chunk_Mesh_Baker>() : nullptr;
+            Node *nd = (baker != nullptr) ? baker->baked_node_at(res.position_, res.normal_) : nullptr;
+            if (nd != nullptr)
+                return nd;
+        }
+        return res.node_;
+    }
+
+    void Selection_Controller::_build_occlusion(const PODVector<Drawable *> &candidates)
+    {
+        occ_buffer_built_ = true;
+
+        if (occ_buffer_ == nullptr)
+            occ_buffer_ = new OcclusionBuffer(context_);
+
+        int height = int(SEL_OCCLUSION_WIDTH / cam_comp_->GetAspectRatio());
+        occ_buffer_->SetSize(SEL_OCCLUSION_WIDTH, Max(height, 1), false);
+        occ_buffer_->SetView(cam_comp_);
+        occ_buffer_->SetMaxTriangles(SEL_OCCLUSION_MAX_TRIANGLES);
+        occ_buffer_->Reset();
+
+        for (uint32_t i = 0; i < candidates.Size(); ++i)
+        {
+            // False means the triangle limit was hit - whatever was not drawn just can not occlude
+            if (!candidates[i]->DrawOcclusion(occ_buffer_))
+            {
+                wout << "Selection occlusion buffer full after" << i << "of" << candidates.Size() << "drawables";
+                break;
+            }
+        }
+
+        occ_buffer_->DrawTriangles();
+        occ_buffer_->BuildDepthHierarchy();
+    }
+
+    bool Selection_Controller::_frontmost_by_occlusion(Drawable *drawable)
+    {
+        // The drawable was rasterized itself, so its own bounding box is never hidden by it
+        return occ_buffer_->IsVisible(drawable->GetWorldBoundingBox());
+    }
+
+    bool Selection_Controller::_frontmost_in_column(Hex_Tile_Grid *tg, Node *nd)
+    {
+        ivec3 cell = Hex_Tile_Grid::world_to_grid(nd->GetWorldPosition());
+        ivec2 column(cell.x_, cell.y_);
+
+        // Every tile in a column shares the lookup
+        auto fiter = cached_column_tops_.Find(column);
+        if (fiter == cached_column_tops_.End())
+        {
+            int32_t top_z = cell.z_;
+            if (!tg->column_top(cell.x_, cell.y_, top_z))
+                top_z = cell.z_;
+            fiter = cached_column_tops_.Insert(MakePair(column, top_z));
+        }
+
+        if (fiter->second_ == cell.z_)
+            return true;
+
+        // The node's origin is not at the top, but one of its other spaces might be
+        return tg->get(ivec3(cell.x_, cell.y_, fiter->second_)).Contains(Hex_Tile_Grid::Tile_Item(nd->GetID()));
+    }
+
+    const PODVector<RayQueryResult> &Selection_Controller::_pick(const fvec2 &norm_mpos, bool precise)
+    {
+        ivec2 sz = ui_container_->GetSize();
+        ivec2 pixel(int(norm_mpos.x_ * sz.x_), int(norm_mpos.y_ * sz.y_));
+        fmat4 view_proj = cam_comp_->GetProjection() * cam_comp_->GetView();
+        Hex_Tile_Grid *tg = scene_->GetComponent<Hex_Tile_Grid>();
+        uint32_t grid_rev = (tg != nullptr) ? tg->revision() : 0;
+
+        // Objects off the grid can move without the revision changing, so only grid picks are ever reused
+        bool hit_alive = last_pick_.Empty() || (last_pick_node_ != nullptr && last_pick_drawable_ != nullptr);
+        if (last_pick_valid_ && hit_alive && !precise && !last_pick_precise_ && pixel == last_pick_pixel_ &&
+            grid_rev == last_pick_grid_rev_ && view_proj == last_pick_view_proj_)
+            return last_pick_;
+
+        last_pick_.Clear();
+        last_pick_valid_ = true;
+        last_pick_precise_ = precise;
+        last_pick_pixel_ = pixel;
+        last_pick_grid_rev_ = grid_rev;
+        last_pick_view_proj_ = view_proj;
+
+        Ray ray = cam_comp_->GetScreenRay(norm_mpos.x_, norm_mpos.y_);
+        float max_dist = M_INFINITY;
+
+        RayQueryResult grid_res;
+        grid_res.drawable_ = nullptr;
+        Hex_Tile_Grid::Grid_Ray_Hit hit;
+        if (tg != nullptr && tg->raycast(ray, hit))
+        {
+            Node *nd = scene_->GetNode(hit.item_.node_id_);
+            StaticModel *sm = (nd != nullptr) ? nd->GetComponent<StaticModel>() : nullptr;
+            if (sm != nullptr)
+            {
+                grid_res.position_ = ray.origin_ + ray.direction_ * hit.distance_;
+                grid_res.normal_ = fvec3::UP;
+                grid_res.distance_ = hit.distance_;
+                grid_res.drawable_ = sm;
+                grid_res.node_ = nd;
+                grid_res.subObject_ = M_MAX_UNSIGNED;
+
+                // The ray enters the cell before it reaches the model surface
+                max_dist = hit.distance_ + 2.0f * X_GRID;
+            }
+        }
+
+        if (grid_res.drawable_ == nullptr || precise)
+        {
+            Octree *oct = scene_->GetComponent<Octree>();
+            RayOctreeQuery q(last_pick_, ray, RAY_TRIANGLE, max_dist, DRAWABLE_GEOMETRY);
+            oct->RaycastSingle(q);
+        }
+
+        if (last_pick_.Empty() && grid_res.drawable_ != nullptr)
+            last_pick_.Push(grid_res);
+
+        last_pick_node_ = last_pick_.Empty() ? nullptr : _hit_node(last_pick_[0]);
+        last_pick_drawable_ = last_pick_.Empty() ? nullptr : last_pick_[0].drawable_;
+        return last_pick_;
+    }
+
+    void Selection_Controller::_update_hover()
+    {
+        if (!hover_enabled_ || hover_mpos_.x_ < 0.0f || cam_comp_ == nullptr || ui_container_ == nullptr)
+        {
+            hover_node_ = nullptr;
+            return;
+        }
+
+        const PODVector<RayQueryResult> &res = _pick(hover_mpos_, false);
+        hover_node_ = res.Empty() ? nullptr : _hit_node(res[0]);
+        if (hover_node_ == nullptr || is_selected(hover_node_))
+            return;
+
+        // A batched tile's own StaticModel is disabled but keeps its bounds - the group's cover the whole chunk
+        Drawable *drawable = hover_node_->GetComponent<StaticModel>();
+        if (drawable == nullptr)
+            drawable = res[0].drawable_;
+
+        DebugRenderer *deb = scene_->GetComponent<DebugRenderer>();
+        if (deb != nullptr)
+            deb->AddBoundingBox(drawable->GetWorldBoundingBox(), HOVER_BOX_COL, true);
+    }
+
+    void Selection_Controller::set_hover_enabled(bool enable)
+    {
+        hover_enabled_ = enable;
+        if (!enable)
+            hover_node_ = nullptr;
+    }
+
+    bool Selection_Controller::hover_enabled() const
+    {
+        return hover_enabled_;
+    }
+
+    Node *Selection_Controller::hovered_node() const
+    {
+        return hover_node_;
+    }
+
+    void Selection_Controller::invalidate_pick_cache()
+    {
+        last_pick_valid_ = false;
+    }
+
+    void Selection_Controller::set_selection_backend(Selection_Backend backend)
+    {
+        sel_backend_ = backend;
+        cached_raycasts_.Clear();
+        cached_column_tops_.Clear();
+    }
+
+    Selection_Controller::Selection_Backend Selection_Controller::selection_backend() const
+    {
+        return sel_backend_;
+    }
+
+    void Selection_Controller::set_selection_mode(Selection_Mode mode)
+    {
+        if (stroke_active_)
+            _end_stroke();
+        sel_mode_ = mode;
+    }
+
+    Selection_Controller::Selection_Mode Selection_Controller::selection_mode() const
+    {
+        return sel_mode_;
+    }
+
+    void Selection_Controller::set_brush_radius(int radius)
+    {
+        brush_radius_ = Max(radius, 0);
+    }
+
+    int Selection_Controller::brush_radius() const
+    {
+        return brush_radius_;
+    }
+
+    void Selection_Controller::select_by_attribute(Attribute_Kind kind, const StringHash &key, bool extend)
+    {
+        _select_indexed(kind, key, nullptr, nullptr, extend);
+    }
+
+    void Selection_Controller::select_by_attribute(Attribute_Kind kind,
+                                                   const StringHash &key,
+                                                   const ivec3 &region_min,
+                                                   const ivec3 &region_max,
+                                                   bool extend)
+    {
+        _select_indexed(kind, key, &region_min, &region_max, extend);
+    }
+
+    void Selection_Controller::select_similar(Node *node, Attribute_Kind kind, bool extend)
+    {
+        if (node == nullptr)
+            return;
+
+        PODVector<StringHash> keys;
+        Attribute_Index::gather_keys(node, kind, keys);
+        if (!extend)
+            clear_selection();
+        for (uint32_t i = 0; i < keys.Size(); ++i)
+            _select_indexed(kind, keys[i], nullptr, nullptr, true);
+    }
+
+    Attribute_Index &Selection_Controller::attribute_index()
+    {
+        return attr_index_;
+    }
+
+    void Selection_Controller::_select_indexed(Attribute_Kind kind,
+                                               const StringHash &key,
+                                               const ivec3 *region_min,
+                                               const ivec3 *region_max,
+                                               bool extend)
+    {
+        if (!extend)
+            clear_selection();
+
+        PODVector<Node *> found;
+        attr_index_.query(kind, key, found);
+        for (uint32_t i = 0; i < found.Size(); ++i)
+        {
+            Node *nd = found[i];
+            if (nd->GetComponent<Selector>() == nullptr)
+                continue;
+
+            if (region_min != nullptr)
+            {
+                ivec3 cell = Hex_Tile_Grid::world_to_grid(nd->GetWorldPosition());
+                if (cell.x_ < region_min->x_ || cell.y_ < region_min->y_ || cell.z_ < region_min->z_ ||
+                    cell.x_ > region_max->x_ || cell.y_ > region_max->y_ || cell.z_ > region_max->z_)
+                    continue;
+            }
+            add_to_selection(nd);
+        }
+    }
+
+    void Selection_Controller::_begin_stroke(const fvec2 &norm_mpos, bool extend)
+    {
+        if (cam_comp_ == nullptr || ui_container_ == nullptr)
+            return;
+
+        if (!extend)
+            clear_selection();
+
+        stroke_active_ = true;
+        lasso_points_.Clear();
+        painted_columns_.Clear();
+        has_last_brush_cell_ = false;
+        _continue_stroke(norm_mpos);
+    }
+
+    void Selection_Controller::_continue_stroke(const fvec2 &norm_mpos)
+    {
+        if (!stroke_active_)
+            return;
+
+        if (sel_mode_ == SEL_MODE_PAINT)
+        {
+            _paint_at(norm_mpos);
+        }
+        else if (sel_mode_ == SEL_MODE_LASSO)
+        {
+            if (lasso_points_.Empty() || (norm_mpos - lasso_points_.Back()).Length() >= SEL_LASSO_MIN_SPACING)
+                lasso_points_.Push(norm_mpos);
+        }
+    }
+
+    void Selection_Controller::_end_stroke()
+    {
+        if (!stroke_active_)
+            return;
+
+        if (sel_mode_ == SEL_MODE_LASSO)
+            _select_lasso();
+
+        stroke_active_ = false;
+        lasso_points_.Clear();
+        painted_columns_.Clear();
+        has_last_brush_cell_ = false;
+    }
+
+    void Selection_Controller::_paint_at(const fvec2 &norm_mpos)
+    {
+        Hex_Tile_Grid *tg = scene_->GetComponent<Hex_Tile_Grid>();
+        if (tg == nullptr)
+            return;
+
+        const PODVector<RayQueryResult> &res = _pick(norm_mpos, false);
+        if (res.Empty())
+            return;
+
+        // The cell just inside the surface that was hit
+        ivec3 cell = Hex_Tile_Grid::world_to_grid(res[0].position_ - res[0].normal_ * (0.5f * Z_GRID));
+
+        // Fill in the cells between this move and the last so a fast stroke does not leave gaps
+        PODVector<ivec3> path;
+        if (has_last_brush_cell_)
+            path = Hex_Tile_Grid::cells_on_line(last_brush_cell_, cell);
+        else
+            path.Push(cell);
+        last_brush_cell_ = cell;
+        has_last_brush_cell_ = true;
+
+        for (uint32_t i = 0; i < path.Size(); ++i)
+        {
+            PODVector<ivec3> brush = Hex_Tile_Grid::cells_in_radius(path[i], brush_radius_);
+            for (uint32_t j = 0; j < brush.Size(); ++j)
+            {
+                ivec2 column(brush[j].x_, brush[j].y_);
+                if (painted_columns_.Contains(column))
+                    continue;
+                painted_columns_.Insert(column);
+
+                int32_t top_z;
+                if (tg->column_top(column.x_, column.y_, top_z))
+                    _select_cell_items(tg, ivec3(column.x_, column.y_, top_z));
+            }
+        }
+    }
+
+    void Selection_Controller::_sub_frustum(const fvec2 &norm_pos, const fvec2 &norm_sz, Frustum &out)
+    {
+        float fov = cam_comp_->GetFov();
+        float ar = cam_comp_->GetAspectRatio();
+        float near_z = cam_comp_->GetNearClip();
+
+        float ws_size_y = near_z * std::tan(radians(fov) / 2.0f);
+        float ws_size_x = ar * -ws_size_y;
+
+        fvec2 ws_sub_pos(ws_size_x * (2.0f * norm_pos.x_ - 1.0f),
+                         ws_size_y * (2.0f * norm_pos.y_ - 1.0f));
+        fvec2 ws_sub_sz(2.0f * norm_sz.x_ * ws_size_x, 2.0f * norm_sz.y_ * ws_size_y);
+
+        fmat4 moved_proj = perspective_from(ws_sub_pos.x_,
+                                            ws_sub_pos.x_ + ws_sub_sz.x_,
+                                            ws_sub_pos.y_ + ws_sub_sz.y_,
+                                            ws_sub_pos.y_,
+                                            near_z,
+                                            1000.0f);
+        out.Define(moved_proj * cam_comp_->GetView());
+    }
+
+    void Selection_Controller::_select_lasso()
+    {
+        Hex_Tile_Grid *tg = scene_->GetComponent<Hex_Tile_Grid>();
+        if (tg == nullptr || cam_comp_ == nullptr || lasso_points_.Size() < 3)
+            return;
+
+        // Only the chunk stacks under the lasso's bounding rect are scanned for column tops
+        fvec2 lo = lasso_points_[0];
+        fvec2 hi = lasso_points_[0];
+        for (uint32_t i = 1; i < lasso_points_.Size(); ++i)
+        {
+            lo = fvec2(Min(lo.x_, lasso_points_[i].x_), Min(lo.y_, lasso_points_[i].y_));
+            hi = fvec2(Max(hi.x_, lasso_points_[i].x_), Max(hi.y_, lasso_points_[i].y_));
+        }
+
+        // A lasso with no area has nothing inside it
+        if (hi.x_ <= lo.x_ || hi.y_ <= lo.y_)
+            return;
+
+        Frustum within;
+        _sub_frustum(lo, hi - lo, within);
+
+        // Only the top of each column can be seen from above so that is all that is tested
+        PODVector<ivec3> tops = tg->column_tops(&within);
+        const fmat3x4 &view = cam_comp_->GetView();
+        for (uint32_t i = 0; i < tops.Size(); ++i)
+        {
+            fvec3 world_pos = Hex_Tile_Grid::grid_to_world(tops[i]);
+            if ((view * world_pos).z_ <= cam_comp_->GetNearClip())
+                continue;
+
+            if (point_in_polygon(cam_comp_->WorldToScreenPoint(world_pos), lasso_points_))
+                _select_cell_items(tg, tops[i]);
+        }
+    }
+
+    void Selection_Controller::_draw_lasso()
+    {
+        if (!stroke_active_ || sel_mode_ != SEL_MODE_LASSO || lasso_points_.Size() < 2)
+            return;
+
+        DebugRenderer *deb = scene_->GetComponent<DebugRenderer>();
+        if (deb == nullptr)
+            return;
+
+        // Draw just past the near plane so the outline is never hidden by the scene
+        float depth = cam_comp_->GetNearClip() * 2.0f;
+        fvec3 first = cam_comp_->ScreenToWorldPoint(fvec3(lasso_points_[0], depth));
+        fvec3 prev = first;
+        for (uint32_t i = 1; i < lasso_points_.Size(); ++i)
+        {
+            fvec3 cur = cam_comp_->ScreenToWorldPoint(fvec3(lasso_points_[i], depth));
+            deb->AddLine(prev, cur, LASSO_COL, false);
+            prev = cur;
+        }
+        deb->AddLine(prev, first, LASSO_COL, false);
+    }
+
+    void Selection_Controller::_select_cell_items(Hex_Tile_Grid *tg, const ivec3 &cell)
+    {
+        Hex_Tile_Grid::Tile_Space items = tg->get(cell);
+        for (uint32_t i = 0; i < items.Size(); ++i)
+        {
+            Node *nd = scene_->GetNode(items[i].node_id_);
+            if (nd != nullptr && nd->GetComponent<Selector>() != nullptr)
+                add_to_selection(nd);
+        }
     }
 
     void Selection_Controller::add_to_selection(Urho3D::Node *obj_node)
@@ -526,7 +1487,12 @@ namespace bbtk
         if (obj_node == nullptr)
             return;
 
+        if (selection_.Contains(obj_node))
+            return;
+
         selection_.Insert(obj_node);
+        _record_added(obj_node);
+        _refresh_selector(obj_node);
     }
 
     void Selection_Controller::handle_input_event(StringHash event_type,
@@ -545,11 +1511,49 @@ namespace bbtk
             return;
         }
 
-        if (name == hashes_[8])
+        // Keep these out of the raycast branch at the bottom or a key press on empty space starts a selection rect
+        if (name == hashes_[10])
+        {
+            // Only remember the cursor - the pick is done once per frame in handle_update
+            hover_mpos_ = norm_mpos;
+        }
+        else if (name == hashes_[8])
         {
             toggle_occ_debug_selection();
         }
-        if (name == hashes_[3])
+        else if (name == hashes_[11])
+        {
+            copy_selection();
+        }
+        else if (name == hashes_[12])
+        {
+            paste_at_cursor();
+        }
+        else if (name == hashes_[13])
+        {
+            duplicate_selection();
+        }
+        else if (name == hashes_[9])
+        {
+            rotate_selection(1);
+        }
+        else if (name == hashes_[14])
+        {
+            set_selection_mode(Selection_Mode((sel_mode_ + 1) % (SEL_MODE_PAINT + 1)));
+        }
+        else if (sel_mode_ != SEL_MODE_RECT && (name == hashes_[0] || name == hashes_[2]))
+        {
+            _begin_stroke(norm_mpos, name == hashes_[2]);
+        }
+        else if (sel_mode_ != SEL_MODE_RECT && (name == hashes_[1] || (name == hashes_[3] && stroke_active_)))
+        {
+            // Strokes replace dragging the selection around
+            if (name == hashes_[3])
+                _continue_stroke(norm_mpos);
+            else if (state == T_END)
+                _end_stroke();
+        }
+        else if (name == hashes_[3])
         {
             // drag_point.w_ is a value used to detect if we are dragging - reset to 0 when draggin stops and set to 1 when
             // dragging starts
@@ -648,6 +1652,7 @@ namespace bbtk
                         ++sel_iter;
                     }
                     cached_raycasts_.Clear();
+                    cached_column_tops_.Clear();
                     ui_selection_rect_->SetVisible(false);
                 }
             }
@@ -675,12 +1680,8 @@ namespace bbtk
         }
         else if (hashes_.Contains(name))
         {
-            Octree *oct = scene_->GetComponent<Octree>();
-            PODVector<RayQueryResult> res;
-
-            // Get the closest object for selection
-            RayOctreeQuery q(res, cam_comp_->GetScreenRay(norm_mpos.x_, norm_mpos.y_), RAY_TRIANGLE, M_INFINITY, DRAWABLE_GEOMETRY);
-            oct->RaycastSingle(q);
+            // Get the closest object for selection - copied since the handlers below can invalidate the pick cache
+            PODVector<RayQueryResult> res = _pick(norm_mpos, true);
 
             // Go through the results from the query - there really should only be one result since we are only doing
             // a single raycast
@@ -688,15 +1689,12 @@ namespace bbtk
             {
                 RayQueryResult &cr = res[i];
 
-                Node *nd = cr.node_;
-
-                StaticModel *sm = nullptr;
-
                 // If the object hit is a static model group then get the instance node
-                if (cr.drawable_->IsInstanceOf<StaticModelGroup>())
-                    nd = static_cast<StaticModelGroup *>(cr.drawable_)->GetInstanceNode(cr.subObject_);
+                Node *nd = _hit_node(cr);
+                if (nd == nullptr)
+                    continue;
 
-                Selector *es = cr.node_->GetComponent<Selector>();
+                Selector *es = nd->GetComponent<Selector>();
                 if (es != nullptr)
                 {
                     if (name == hashes_[0])
@@ -704,14 +1702,17 @@ namespace bbtk
                         if (!es->is_selected())
                         {
                             clear_selection();
-                            add_to_selection(cr.node_);
+                            add_to_selection(nd);
                         }
                     }
                     else if (name == hashes_[1])
                     {
                         drag_point_ = fvec4();
                         if (state == T_BEGIN)
+                        {
                             drag_point_ = fvec4(cr.position_, 1.0f);
+                            drag_validator_.clear();
+                        }
                         else
                         {
                             if (ui_selection_rect_->IsVisible())
@@ -725,6 +1726,7 @@ namespace bbtk
                                 }
 
                                 cached_raycasts_.Clear();
+                                cached_column_tops_.Clear();
                                 ui_selection_rect_->SetVisible(false);
                             }
                             if (!move_allowed_)
@@ -743,7 +1745,7 @@ namespace bbtk
                         }
                         else
                         {
-                            add_to_selection(cr.node_);
+                            add_to_selection(nd);
                         }
                     }
                 }
@@ -787,6 +1789,7 @@ namespace bbtk
                         }
 
                         cached_raycasts_.Clear();
+                        cached_column_tops_.Clear();
                         ui_selection_rect_->SetVisible(false);
                     }
                 }
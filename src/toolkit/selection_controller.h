@@ -4,8 +4,12 @@
 #include <Urho3D/Graphics/OctreeQuery.h>
 #include <Urho3D/Graphics/OcclusionBuffer.h>
 #include <Urho3D/Container/HashSet.h>
+#include <Urho3D/IO/VectorBuffer.h>
 #include <Urho3D/Scene/Component.h>
 
+#include "attribute_index.h"
+#include "drag_validator.h"
+
 const Urho3D::String SEL_OBJ_NAME = "SelectObject";
 const Urho3D::String DRAG_SELECTED_OBJECT = "DragSelectedObject";
 const Urho3D::String EXTEND_SEL_OBJ_NAME = "ExtendObjectSelection";
@@ -15,12 +19,27 @@ const Urho3D::String Z_MOVE_HELD = "ZMoveHeld";
 const Urho3D::String X_MOVE_HELD = "XMoveHeld";
 const Urho3D::String Y_MOVE_HELD = "YMoveHeld";
 const Urho3D::String TOGGLE_OCC_DEBUG = "ToggleOccDebug";
+const Urho3D::String ROTATE_SELECTION = "RotateSelection";
+const Urho3D::String HOVER_OBJECT = "HoverObject";
+const Urho3D::String COPY_SELECTION = "CopySelection";
+const Urho3D::String PASTE_SELECTION = "PasteSelection";
+const Urho3D::String DUPLICATE_SELECTION = "DuplicateSelection";
+const Urho3D::String CYCLE_SELECTION_MODE = "CycleSelectionMode";
 const Urho3D::Color SEL_RECT_BORDER_COL = Urho3D::Color(0.0f, 0.0f, 0.7f, 0.6f);
 const int BORDER_SIZE = 1;
 const Urho3D::Color SEL_RECT_COL = Urho3D::Color(0.0f, 0.0f, 0.7f, 0.2f);
+const Urho3D::Color HOVER_BOX_COL = Urho3D::Color(1.0f, 0.8f, 0.0f, 0.8f);
+const Urho3D::Color LASSO_COL = Urho3D::Color(0.0f, 0.0f, 0.7f, 0.8f);
 const int Z_MOVE_FLAG = 1;
 const int X_MOVE_FLAG = 2;
 const int Y_MOVE_FLAG = 4;
+const int SEL_OCCLUSION_WIDTH = 256;
+const unsigned SEL_OCCLUSION_MAX_TRIANGLES = 200000;
+// Below this many nodes transforms are computed on the main thread - the work queue round trip is not worth it
+const unsigned SEL_XFORM_PARALLEL_MIN = 2048;
+const int SEL_DEFAULT_BRUSH_RADIUS = 1;
+// Lasso points closer than this (in viewport normalized coords) to the previous point are dropped
+const float SEL_LASSO_MIN_SPACING = 0.005f;
 
 namespace Urho3D
 {
@@ -30,10 +49,14 @@ class Scene;
 class UIElement;
 class Viewport;
 class BorderImage;
+class Drawable;
+class Frustum;
+struct WorkItem;
 } // namespace Urho3D
 
 
 struct Input_Context;
+class Hex_Tile_Grid;
 
 namespace bbtk
 {
@@ -44,6 +67,37 @@ class Selection_Controller : public Urho3D::Component
     URHO3D_OBJECT(Selection_Controller, Urho3D::Component)
 
   public:
+    enum Selection_Transform
+    {
+        // Add the param to every world position
+        SEL_XFORM_TRANSLATE,
+        // Snap every world position to the grid, param is unused
+        SEL_XFORM_SNAP
+    };
+
+    // How the selection rect decides whether a node in the rect is frontmost
+    enum Selection_Backend
+    {
+        // OBB raycast from the camera to every candidate node
+        SEL_BACKEND_OCTREE,
+        // Grid occupiers are frontmost if they are at the top of their grid column - one cached lookup per column.
+        // Anything else is tested against the occlusion buffer.
+        SEL_BACKEND_GRID,
+        // Rasterize the rect's candidates in to a CPU depth buffer once per update and depth test each candidate
+        SEL_BACKEND_OCCLUSION
+    };
+
+    // What a plain left drag does - shift drag is always the selection rect
+    enum Selection_Mode
+    {
+        // Click to select, drag to move the selection
+        SEL_MODE_RECT,
+        // Drag out a polygon - the top tile of every grid column whose centre falls inside it is selected on release
+        SEL_MODE_LASSO,
+        // Drag a brush over the grid - the top tile of every column under the brush is selected as it is covered
+        SEL_MODE_PAINT
+    };
+
     Selection_Controller(Urho3D::Context * context);
     ~Selection_Controller();
 
@@ -61,12 +115,81 @@ class Selection_Controller : public Urho3D::Component
 
     void translate_selection(const fvec3 & translation);
 
+    /*!
+    Transform the world position of every node in nodes. New positions are computed on the work queue for large
+    batches and then set on the main thread with the grid's per node move handling suppressed - the moved occupiers
+    are handed to the grid in one go afterwards. Setting the positions (and the scene's own dirty propagation) is
+    still one node at a time.
+    */
+    void transform_nodes(const Urho3D::PODVector<Urho3D::Node *> & nodes, Selection_Transform op, const fvec3 & param);
+
+    void rotate_selection(int steps);
+
     void delete_selection();
 
+    // Snapshot the selected nodes (children included) in to the clipboard in the scene's binary node format
+    void copy_selection();
+
+    // Instantiate the clipboard so its anchor cell lands on anchor_cell and select the new nodes - the grid registers
+    // all of the new footprints in one batch once every node is loaded
+    void paste_clipboard(const ivec3 & anchor_cell);
+
+    // Paste on top of whatever is under the cursor, or in place if there is nothing under it
+    void paste_at_cursor();
+
+    // Copy the selection and paste it stacked directly on top of itself
+    void duplicate_selection();
+
+    bool clipboard_empty() const;
+
     void toggle_occ_debug_selection();
 
     void remove_from_selection(Urho3D::Node * node);
 
+    void set_selection_backend(Selection_Backend backend);
+
+    Selection_Backend selection_backend() const;
+
+    void set_selection_mode(Selection_Mode mode);
+
+    Selection_Mode selection_mode() const;
+
+    // Brush radius in hex steps - 0 paints a single column
+    void set_brush_radius(int radius);
+
+    int brush_radius() const;
+
+    /*!
+    Select every node carrying key - a model, material or tag name hash depending on kind. Costs the number of nodes
+    with the key, not the number of nodes in the scene. Without extend the selection is replaced.
+    */
+    void select_by_attribute(Attribute_Kind kind, const Urho3D::StringHash & key, bool extend = false);
+
+    // Same but only nodes whose origin cell is inside the grid region [region_min, region_max]
+    void select_by_attribute(Attribute_Kind kind,
+                             const Urho3D::StringHash & key,
+                             const ivec3 & region_min,
+                             const ivec3 & region_max,
+                             bool extend = false);
+
+    // Select every node sharing any of node's keys of kind
+    void select_similar(Urho3D::Node * node, Attribute_Kind kind, bool extend = false);
+
+    Attribute_Index & attribute_index();
+
+    // Outline the node under the cursor every frame
+    void set_hover_enabled(bool enable);
+
+    bool hover_enabled() const;
+
+    Urho3D::Node * hovered_node() const;
+
+    // Force the next pick to raycast even if the camera and cursor have not moved
+    void invalidate_pick_cache();
+
+    // Incremented every time E_SELECTION_CHANGED is sent
+    uint32_t selection_generation() const;
+
     void set_camera(Urho3D::Camera * cam);
 
     Urho3D::Camera * get_camera();
@@ -81,6 +204,8 @@ class Selection_Controller : public Urho3D::Component
 
     void handle_component_removed(Urho3D::StringHash event_type, Urho3D::VariantMap & event_data);
 
+    void handle_node_tag_changed(Urho3D::StringHash event_type, Urho3D::VariantMap & event_data);
+
     void setup_input_context(Input_Context * ctxt);
 
     static void register_context(Urho3D::Context * ctxt);
@@ -91,6 +216,85 @@ class Selection_Controller : public Urho3D::Component
   private:
     void _add_to_selection_from_rect();
 
+    // The part of the camera frustum behind the viewport normalized rect at norm_pos with size norm_sz
+    void _sub_frustum(const fvec2 & norm_pos, const fvec2 & norm_sz, Urho3D::Frustum & out);
+
+    // Push the node's current selection state to its Selector - only called for nodes whose state may have changed
+    void _refresh_selector(Urho3D::Node * node);
+
+    bool _frontmost_by_raycast(Urho3D::Node * nd);
+
+    // The node a ray hit - the instance node for a StaticModelGroup hit
+    static Urho3D::Node * _hit_node(const Urho3D::RayQueryResult & res);
+
+    bool _frontmost_in_column(Hex_Tile_Grid * tg, Urho3D::Node * nd);
+
+    // Rasterize the candidates in to occ_buffer_ from the selection camera - software only, no GPU needed
+    void _build_occlusion(const Urho3D::PODVector<Urho3D::Drawable *> & candidates);
+
+    bool _frontmost_by_occlusion(Urho3D::Drawable * drawable);
+
+    /*!
+    Pick the object under the cursor. The grid is ray marched first and only if that misses (or the occupier has no
+    model) is the octree triangle raycast done. A precise pick also triangle tests anything off the grid up to the grid
+    hit, so an object in front of the grid is not picked through. Non precise results are reused while the camera, the
+    cursor pixel and the grid revision are unchanged - precise picks always raycast since what they hit off the grid
+    can move without the grid knowing.
+    */
+    const Urho3D::PODVector<Urho3D::RayQueryResult> & _pick(const fvec2 & norm_mpos, bool precise);
+
+    void _update_hover();
+
+    // Lasso and paint strokes - ctrl strokes extend the selection, plain strokes replace it
+    void _begin_stroke(const fvec2 & norm_mpos, bool extend);
+
+    void _continue_stroke(const fvec2 & norm_mpos);
+
+    void _end_stroke();
+
+    // Select the columns under the brush between the last brush cell and the cell under norm_mpos
+    void _paint_at(const fvec2 & norm_mpos);
+
+    void _select_lasso();
+
+    void _draw_lasso();
+
+    void _select_indexed(Attribute_Kind kind,
+                         const Urho3D::StringHash & key,
+                         const ivec3 * region_min,
+                         const ivec3 * region_max,
+                         bool extend);
+
+    // Add every selectable node with an active item in cell
+    void _select_cell_items(Hex_Tile_Grid * tg, const ivec3 & cell);
+
+    struct Transform_Job
+    {
+        const fvec3 * src_;
+        fvec3 * dst_;
+        uint32_t count_;
+        Selection_Transform op_;
+        fvec3 param_;
+    };
+
+    static void _run_transform_job(const Urho3D::WorkItem * item, uint32_t thread_index);
+
+    static void _transform_positions(const Transform_Job & job);
+
+    // Set the world position and rotation of each node with the grid's per node move handling suppressed, then hand
+    // the moved occupiers to the grid in one go
+    void _set_world_transforms(const Urho3D::PODVector<Urho3D::Node *> & nodes,
+                               const Urho3D::PODVector<fvec3> & positions,
+                               const Urho3D::PODVector<fquat> & rotations);
+
+    // Record a node entering or leaving selection_ - a node which enters and leaves in the same frame cancels out
+    void _record_added(Urho3D::Node * node);
+
+    void _record_removed(Urho3D::Node * node);
+
+    // Send E_SELECTION_CHANGED with the deltas recorded since the last send, if there are any
+    void _send_selection_changed();
+
     HashSet<Urho3D::Node *> selection_;
 
     HashSet<Urho3D::Node *> sel_rect_selection_;
@@ -109,8 +313,80 @@ class Selection_Controller : public Urho3D::Component
 
     HashMap<Urho3D::Node *, bool> cached_raycasts_;
 
+    // Highest occupied z of each grid column touched by the current selection rect
+    HashMap<ivec2, int32_t> cached_column_tops_;
+
     Urho3D::HashSet<Selector *> scene_sel_comps_;
 
+    // Every node in the scene with a Selector or Tile_Occupier, by model, material and tag
+    Attribute_Index attr_index_;
+
+    HashSet<Urho3D::Node *> sel_added_;
+
+    HashSet<Urho3D::Node *> sel_removed_;
+
+    uint32_t sel_generation_;
+
+    // Collision state of the selection against the rest of the grid, snapshotted on selection change and drag start
+    Drag_Validator drag_validator_;
+
+    Selection_Backend sel_backend_;
+
+    Urho3D::SharedPtr<Urho3D::OcclusionBuffer> occ_buffer_;
+
+    // Whether occ_buffer_ holds the candidates of the current rect update
+    bool occ_buffer_built_;
+
+    Urho3D::PODVector<Urho3D::RayQueryResult> last_pick_;
+
+    Urho3D::WeakPtr<Urho3D::Node> last_pick_node_;
+
+    // The cached hit's drawable - the result only holds a raw pointer and batch groups or chunk meshes can be freed
+    Urho3D::WeakPtr<Urho3D::Drawable> last_pick_drawable_;
+
+    fmat4 last_pick_view_proj_;
+
+    ivec2 last_pick_pixel_;
+
+    uint32_t last_pick_grid_rev_;
+
+    bool last_pick_precise_;
+
+    bool last_pick_valid_;
+
+    bool hover_enabled_;
+
+    // Viewport normalized cursor position from the last mouse move, negative until the mouse has moved
+    fvec2 hover_mpos_;
+
+    Urho3D::WeakPtr<Urho3D::Node> hover_node_;
+
+    Selection_Mode sel_mode_;
+
+    int brush_radius_;
+
+    bool stroke_active_;
+
+    // Viewport normalized points of the lasso being drawn
+    Urho3D::PODVector<fvec2> lasso_points_;
+
+    // Columns the current paint stroke has already covered - each is only looked up once per stroke
+    Urho3D::HashSet<ivec2> painted_columns_;
+
+    ivec3 last_brush_cell_;
+
+    bool has_last_brush_cell_;
+
+    // World position and rotation followed by the saved node, for each copied top level node
+    Urho3D::VectorBuffer clipboard_;
+
+    uint32_t clipboard_count_;
+
+    // Cell at the bottom centre of the copied nodes and how many layers they span
+    ivec3 clipboard_anchor_;
+
+    int32_t clipboard_height_;
+
     fvec3 frame_translation_;
 
     fvec4 drag_point_;
@@ -130,11 +406,13 @@ class Selection_Controller : public Urho3D::Component
 
 namespace Urho3D
 {
-/// Input Trigger Event
+/// Sent once per frame at most, only when nodes entered or left the selection. Removed nodes may already be
+/// deleted - only use those pointers as keys.
 URHO3D_EVENT(E_SELECTION_CHANGED, SelectionChanged)
 {
-    URHO3D_PARAM(P_PREV_SELECTION, prev_selection); // VariantVector
-    URHO3D_PARAM(P_CUR_SELECTION, cur_selection); // VariantVector
+    URHO3D_PARAM(P_ADDED, added); // VariantVector of Node pointers
+    URHO3D_PARAM(P_REMOVED, removed); // VariantVector of Node pointers
+    URHO3D_PARAM(P_GENERATION, generation); // unsigned
 }
 
 };
\ No newline at end of file
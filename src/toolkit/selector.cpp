@@ -1,37 +1,42 @@
 #include <Urho3D/Scene/Node.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/StaticModel.h>
+#include <Urho3D/Core/Context.h>
 
 #include <urho_common.h>
+#include <tile_batcher.h>
+#include <chunk_mesh_baker.h>
+#include <buried_tile_culler.h>
 #include <string>
 
+#include "outline_cache.h"
 #include "selector.h"
 
 namespace bbtk
 {
 
 Selector::Selector(Urho3D::Context * context)
-    : Urho3D::StaticModel(context)
+    : Urho3D::Component(context), selected_(false), outline_state_(OUTLINE_NORMAL)
 {}
 
 void Selector::set_selected(bool select)
 {
-    Urho3D::Scene * scn = GetScene();
-    if (scn == nullptr)
+    if (select == selected_)
         return;
 
-    Urho3D::StaticModel * comp = node_->GetComponent<StaticModel>();
-
-    if ((select && is_selected()) || (!select && !is_selected()))
+    selected_ = select;
+    if (GetScene() == nullptr)
         return;
 
-    if (comp != nullptr)
-        comp->SetEnabled(!select);
-
-    SetEnabled(select);
+    if (selected_)
+        _apply();
+    else
+        _restore();
 }
 
 bool Selector::is_selected()
 {
-    return IsEnabled();
+    return selected_;
 }
 
 void Selector::toggle_selected()
@@ -39,9 +44,127 @@ void Selector::toggle_selected()
     set_selected(!is_selected());
 }
 
+void Selector::set_outline_state(Outline_State state)
+{
+    if (state == outline_state_)
+        return;
+
+    outline_state_ = state;
+    if (selected_ && GetScene() != nullptr)
+        _apply();
+}
+
+Selector::Outline_State Selector::outline_state() const
+{
+    return outline_state_;
+}
+
+Urho3D::Material * Selector::outline_material(Urho3D::Material * base, Outline_State state)
+{
+    if (base == nullptr)
+        return nullptr;
+
+    Outline_Cache * cache = base->GetSubsystem<Outline_Cache>();
+    return (cache != nullptr) ? cache->material(base, state) : base;
+}
+
+Urho3D::Material * Selector::base_material(uint32_t geom) const
+{
+    if (selected_ && geom < base_materials_.Size())
+        return base_materials_[geom];
+
+    Urho3D::StaticModel * comp = (node_ != nullptr) ? node_->GetComponent<Urho3D::StaticModel>() : nullptr;
+    return (comp != nullptr) ? comp->GetMaterial(geom) : nullptr;
+}
+
+void Selector::suspend_outline()
+{
+    Urho3D::StaticModel * comp = (node_ != nullptr) ? node_->GetComponent<Urho3D::StaticModel>() : nullptr;
+    if (!selected_ || comp == nullptr)
+        return;
+
+    uint32_t geom_count = Urho3D::Min(comp->GetNumGeometries(), base_materials_.Size());
+    for (uint32_t i = 0; i < geom_count; ++i)
+        comp->SetMaterial(i, base_materials_[i]);
+}
+
+void Selector::resume_outline()
+{
+    if (selected_ && node_ != nullptr && GetScene() != nullptr)
+        _apply_materials();
+}
+
 void Selector::register_context(Urho3D::Context * context)
 {
     context->RegisterFactory<Selector>();
-    URHO3D_ACCESSOR_ATTRIBUTE("Is Enabled", IsEnabled, SetEnabled, bool, true, Urho3D::AM_DEFAULT);
+    if (context->GetSubsystem<Outline_Cache>() == nullptr)
+        context->RegisterSubsystem(new Outline_Cache(context));
+}
+
+void Selector::_apply()
+{
+    if (!node_->HasComponent<Urho3D::StaticModel>())
+        return;
+
+    // Batched and baked tiles have to draw with their own model while their materials differ from the group's
+    Tile_Batcher * batcher = GetScene()->GetComponent<Tile_Batcher>();
+    if (batcher != nullptr)
+        batcher->set_excluded(node_, true);
+    Chunk_Mesh_Baker * baker = GetScene()->GetComponent<Chunk_Mesh_Baker>();
+    if (baker != nullptr)
+        baker->set_excluded(node_, true);
+    // Selected tiles are drawn even when buried so their outline shows through
+    Buried_Tile_Culler * culler = GetScene()->GetComponent<Buried_Tile_Culler>();
+    if (culler != nullptr)
+        culler->set_excluded(node_, true);
+
+    _apply_materials();
+}
+
+void Selector::_apply_materials()
+{
+    Urho3D::StaticModel * comp = node_->GetComponent<Urho3D::StaticModel>();
+    if (comp == nullptr)
+        return;
+
+    uint32_t geom_count = comp->GetNumGeometries();
+    if (base_materials_.Size() != geom_count)
+    {
+        base_materials_.Resize(geom_count);
+        for (uint32_t i = 0; i < geom_count; ++i)
+            base_materials_[i] = comp->GetMaterial(i);
+    }
+
+    Outline_Cache * cache = GetSubsystem<Outline_Cache>();
+    for (uint32_t i = 0; i < geom_count; ++i)
+    {
+        // Something else replaced the material while selected - that becomes the new base
+        Urho3D::Material * cur = comp->GetMaterial(i);
+        if (cur != base_materials_[i] && (cache == nullptr || !cache->is_variant(cur)))
+            base_materials_[i] = cur;
+        comp->SetMaterial(i, outline_material(base_materials_[i], outline_state_));
+    }
+}
+
+void Selector::_restore()
+{
+    Urho3D::StaticModel * comp = node_->GetComponent<Urho3D::StaticModel>();
+    if (comp != nullptr)
+    {
+        uint32_t geom_count = Urho3D::Min(comp->GetNumGeometries(), base_materials_.Size());
+        for (uint32_t i = 0; i < geom_count; ++i)
+            comp->SetMaterial(i, base_materials_[i]);
+    }
+    base_materials_.Clear();
+
+    Tile_Batcher * batcher = GetScene()->GetComponent<Tile_Batcher>();
+    if (batcher != nullptr)
+        batcher->set_excluded(node_, false);
+    Chunk_Mesh_Baker * baker = GetScene()->GetComponent<Chunk_Mesh_Baker>();
+    if (baker != nullptr)
+        baker->set_excluded(node_, false);
+    Buried_Tile_Culler * culler = GetScene()->GetComponent<Buried_Tile_Culler>();
+    if (culler != nullptr)
+        culler->set_excluded(node_, false);
 }
 }
\ No newline at end of file
@@ -1,11 +1,16 @@
 #pragma once
 
-#include <Urho3D/Graphics/StaticModel.h>
+#include <Urho3D/Scene/Component.h>
+#include <Urho3D/Math/Color.h>
+
+const Urho3D::Color SEL_OUTLINE_COL = Urho3D::Color(0.0f, 0.0f, 1.0f, 1.0f);
+const Urho3D::Color SEL_OUTLINE_BLOCKED_COL = Urho3D::Color(1.0f, 0.0f, 0.0f, 1.0f);
 
 namespace Urho3D
 {
 class Node;
 class Context;
+class Material;
 class StaticModel;
 } // namespace Urho3D
 
@@ -14,11 +19,25 @@ class StaticModel;
 namespace bbtk
 {
 
-class Selector : public Urho3D::StaticModel
+/*!
+Marks a node as selectable and draws its selection outline. Selecting swaps each of the node's StaticModel materials
+for an outline variant of itself and deselecting puts the originals back - there is no second drawable. Variants are
+made once per base material and outline state by the Outline_Cache subsystem and shared by every selected node, so a
+selection of thousands of tiles with the same material still batches together, and blocked and free nodes can show
+different colours in the same frame without anything touching a material's parameters.
+*/
+class Selector : public Urho3D::Component
 {
-    URHO3D_OBJECT(Selector, Component);
+    URHO3D_OBJECT(Selector, Urho3D::Component);
 
   public:
+    enum Outline_State
+    {
+        OUTLINE_NORMAL,
+        OUTLINE_BLOCKED,
+        OUTLINE_STATE_COUNT
+    };
+
     /// Construct.
     Selector(Urho3D::Context * context);
 
@@ -28,11 +47,41 @@ class Selector : public Urho3D::StaticModel
 
     void toggle_selected();
 
+    // Switch between the normal and blocked outline - remembered while deselected
+    void set_outline_state(Outline_State state);
+
+    Outline_State outline_state() const;
+
+    // The shared outline variant of base for state, made the first time it is asked for
+    static Urho3D::Material * outline_material(Urho3D::Material * base, Outline_State state);
+
+    // The material geometry geom draws with when not selected - outline variants are clones that are not in the
+    // resource cache, so this is what anything saving or comparing materials should look at
+    Urho3D::Material * base_material(uint32_t geom) const;
+
+    // Put the base materials back on the model without deselecting (ie around saving the node) and the outline
+    // variants again afterwards
+    void suspend_outline();
+
+    void resume_outline();
+
     static void register_context(Urho3D::Context * context);
 
   protected:
     //void OnNodeSet(Node * node) override;
 
   private:
+    void _apply();
+
+    void _apply_materials();
+
+    void _restore();
+
+    bool selected_;
+
+    Outline_State outline_state_;
+
+    // The model materials the outline variants replaced, by geometry index
+    Urho3D::Vector<Urho3D::SharedPtr<Urho3D::Material>> base_materials_;
 };
 }
\ No newline at end of file